@@ -0,0 +1,140 @@
+/*
+ * libyoboy: the yoBoy emulator core behind a C API, for running many
+ * machines inside one process.
+ *
+ * Instances are independent of each other and may run on different threads;
+ * a single instance must not be used from two threads at once.
+ */
+#ifndef YOBOY_H
+#define YOBOY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define YOBOY_API __attribute__((visibility("default")))
+#else
+#define YOBOY_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a function changes in an incompatible way. */
+#define YOBOY_API_VERSION 1
+
+#define YOBOY_SCREEN_WIDTH 160
+#define YOBOY_SCREEN_HEIGHT 144
+
+/* Joypad buttons for yoboy_set_input; a set bit means the button is held. */
+enum {
+    YOBOY_BUTTON_RIGHT  = 1 << 0,
+    YOBOY_BUTTON_LEFT   = 1 << 1,
+    YOBOY_BUTTON_UP     = 1 << 2,
+    YOBOY_BUTTON_DOWN   = 1 << 3,
+    YOBOY_BUTTON_A      = 1 << 4,
+    YOBOY_BUTTON_B      = 1 << 5,
+    YOBOY_BUTTON_SELECT = 1 << 6,
+    YOBOY_BUTTON_START  = 1 << 7
+};
+
+typedef struct yoboy yoboy;
+
+/* YOBOY_API_VERSION of the library actually loaded. */
+YOBOY_API unsigned yoboy_api_version(void);
+
+/* The core can log what it runs to stdout. Logging is off by default; this
+ * turns it on or back off for the whole process. */
+YOBOY_API void yoboy_set_logging(int enabled);
+
+/* Powers on a machine running a copy of the size byte ROM image. Returns NULL
+ * if the cartridge is too small or of a type the core can't run, or if memory
+ * runs out. */
+YOBOY_API yoboy* yoboy_create(const uint8_t* rom, size_t size);
+YOBOY_API void yoboy_destroy(yoboy* instance);
+
+/* Emulates until the PPU completes the next frame. */
+YOBOY_API void yoboy_run_frame(yoboy* instance);
+
+/* Sets the held buttons, a combination of YOBOY_BUTTON_ flags. */
+YOBOY_API void yoboy_set_input(yoboy* instance, uint8_t buttons);
+
+/* YOBOY_SCREEN_WIDTH x YOBOY_SCREEN_HEIGHT ARGB8888 pixels, row by row. The
+ * pointer stays valid for the instance's lifetime and the pixels are updated
+ * in place by yoboy_run_frame. */
+YOBOY_API const uint32_t* yoboy_framebuffer(const yoboy* instance);
+
+/* Copies up to max_frames stereo frames of interleaved 16 bit samples at
+ * yoboy_audio_rate() Hz into samples and returns how many were copied. The
+ * core has no APU yet, so this is always 0 for now. */
+YOBOY_API size_t yoboy_audio_samples(yoboy* instance, int16_t* samples, size_t max_frames);
+YOBOY_API unsigned yoboy_audio_rate(const yoboy* instance);
+
+/* Bytes yoboy_save_state needs for the instance's current state, or 0 if
+ * memory runs out. */
+YOBOY_API size_t yoboy_state_size(const yoboy* instance);
+
+/* Writes the machine state to buffer. Returns the number of bytes written, or
+ * 0 if size is smaller than yoboy_state_size or memory runs out. */
+YOBOY_API size_t yoboy_save_state(const yoboy* instance, void* buffer, size_t size);
+
+/* Restores a state saved from an instance of the same ROM. Returns 0 and
+ * leaves the machine as it was if the state is invalid or truncated. Also
+ * returns 0 if memory runs out, possibly with the state partly loaded. */
+YOBOY_API int yoboy_load_state(yoboy* instance, const void* buffer, size_t size);
+
+/* A new instance continuing from where this one is, sharing its memory until
+ * either writes to it: cheaper than saving and loading a state for each of
+ * many branches tried from one point. Destroy it with yoboy_destroy. Its
+ * framebuffer is only complete again after a frame. Returns NULL if memory
+ * runs out. */
+YOBOY_API yoboy* yoboy_fork(yoboy* instance);
+
+/*
+ * Vectorized environments: count machines of one ROM stepped a frame at a
+ * time together on a pool of threads, for workloads like reinforcement
+ * learning that run many at once.
+ */
+
+/* Frame layouts for yoboy_vec_step. */
+enum {
+    YOBOY_FRAME_ARGB8888 = 0, /* uint32_t a pixel */
+    YOBOY_FRAME_GRAY8 = 1     /* uint8_t of BT.601 luma a pixel */
+};
+
+typedef struct yoboy_vec yoboy_vec;
+
+/* threads == 0 sizes the pool to the machine. Returns NULL if the cartridge
+ * can't be run or if memory or threads run out. */
+YOBOY_API yoboy_vec* yoboy_vec_create(const uint8_t* rom, size_t size, size_t count, size_t threads);
+YOBOY_API void yoboy_vec_destroy(yoboy_vec* vec);
+
+YOBOY_API size_t yoboy_vec_count(const yoboy_vec* vec);
+
+/* Bytes one machine's frame takes in yoboy_vec_step's output when shrunk by
+ * downscale (1, 2 or 4) in each direction; 0 for anything else. */
+YOBOY_API size_t yoboy_vec_frame_size(int format, int downscale);
+
+/* Runs every machine i for a frame holding inputs[i] (NULL for none). If
+ * frames isn't NULL, writes count frames of yoboy_vec_frame_size bytes into
+ * it back to back, each frame row by row and each pixel the average of a
+ * downscale x downscale box. Returns 0 without running anything for an
+ * invalid format or downscale. */
+YOBOY_API int yoboy_vec_step(yoboy_vec* vec, const uint8_t* inputs, void* frames, int format, int downscale);
+
+/* Frames machine index has run since it was created or reset. */
+YOBOY_API uint64_t yoboy_vec_frames(const yoboy_vec* vec, size_t index);
+
+/* Puts machine index back into its power on state. */
+YOBOY_API void yoboy_vec_reset(yoboy_vec* vec, size_t index);
+
+/* Like yoboy_save_state and yoboy_load_state for machine index. */
+YOBOY_API size_t yoboy_vec_save_state(const yoboy_vec* vec, size_t index, void* buffer, size_t size);
+YOBOY_API int yoboy_vec_load_state(yoboy_vec* vec, size_t index, const void* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,5 +1,5 @@
 workspace "yoBoy"
-   configurations { "Debug", "Release" }
+   configurations { "Debug", "Release", "Profile" }
    warnings "Extra"
 
 project "yoboy"
@@ -12,8 +12,9 @@ project "yoboy"
    location ("build")
 
    files { "src/**.h", "src/**.cc" }
+   removefiles { "src/yoboy.cc" }
 
-   links { "SDL2" }
+   links { "SDL2", "pthread" }
 
    filter "configurations:Debug"
       defines { "DEBUG" }
@@ -22,3 +23,130 @@ project "yoboy"
    filter "configurations:Release"
       defines { "NDEBUG" }
       optimize "On"
+
+   filter "configurations:Profile"
+      defines { "NDEBUG", "YB_PROFILE" }
+      optimize "On"
+      symbols "On"
+
+-- Runs test ROMs headless, so CI machines need neither SDL nor a display.
+project "yoboy-harness"
+   kind "ConsoleApp"
+
+   language "C++"
+   cppdialect "C++14"
+
+   targetdir ("build/%{cfg.longname}")
+   location ("build")
+
+   files { "src/**.h", "src/**.cc", "tools/harness.cc" }
+   removefiles { "src/main.cc", "src/yoboy.cc", "src/window.h", "src/window.cc" }
+   includedirs { "src" }
+   defines { "YB_NO_WINDOW" }
+
+   links { "pthread" }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+   filter "configurations:Profile"
+      defines { "NDEBUG", "YB_PROFILE" }
+      optimize "On"
+      symbols "On"
+
+project "yoboy-trace"
+   kind "ConsoleApp"
+
+   language "C++"
+   cppdialect "C++14"
+
+   targetdir ("build/%{cfg.longname}")
+   location ("build")
+
+   files { "src/trace.h", "src/trace.cc", "src/disasm.h", "src/disasm.cc",
+           "src/ops.h", "src/ops.cc", "src/savestate.h", "src/savestate.cc",
+           "tools/ybtrace.cc" }
+   includedirs { "src" }
+
+   links { "pthread" }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+   filter "configurations:Profile"
+      defines { "NDEBUG", "YB_PROFILE" }
+      optimize "On"
+      symbols "On"
+
+-- The core without SDL, the window or the tools, for embedding through the C
+-- API in include/yoboy.h. Both kinds build as libyoboy; only the C API is
+-- exported from the shared one.
+project "yoboy-static"
+   kind "StaticLib"
+   targetname "yoboy"
+
+   language "C++"
+   cppdialect "C++14"
+   pic "On"
+
+   targetdir ("build/%{cfg.longname}")
+   location ("build")
+
+   files { "include/yoboy.h", "src/**.h", "src/**.cc" }
+   removefiles { "src/main.cc", "src/window.h", "src/window.cc" }
+   includedirs { "include", "src" }
+   defines { "YB_NO_WINDOW" }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+   filter "configurations:Profile"
+      defines { "NDEBUG", "YB_PROFILE" }
+      optimize "On"
+      symbols "On"
+
+project "yoboy-shared"
+   kind "SharedLib"
+   targetname "yoboy"
+
+   language "C++"
+   cppdialect "C++14"
+   visibility "Hidden"
+
+   targetdir ("build/%{cfg.longname}")
+   location ("build")
+
+   files { "include/yoboy.h", "src/**.h", "src/**.cc" }
+   removefiles { "src/main.cc", "src/window.h", "src/window.cc" }
+   includedirs { "include", "src" }
+   defines { "YB_NO_WINDOW" }
+
+   links { "pthread" }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+   filter "configurations:Profile"
+      defines { "NDEBUG", "YB_PROFILE" }
+      optimize "On"
+      symbols "On"
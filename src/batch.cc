@@ -0,0 +1,176 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <dirent.h>
+
+#include "common.h"
+#include "emulator.h"
+#include "thread_pool.h"
+
+namespace yb {
+
+static bool has_rom_extension(const std::string& name)
+{
+    const size_t dot = name.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+
+    const std::string ext = name.substr(dot);
+
+    return ext == ".gb" || ext == ".gbc";
+}
+
+static std::vector<std::string> list_roms(const std::string& source)
+{
+    std::vector<std::string> roms;
+
+    if (DIR* dir = opendir(source.c_str())) {
+        while (dirent* entry = readdir(dir)) {
+            if (has_rom_extension(entry->d_name)) {
+                roms.push_back(source + "/" + entry->d_name);
+            }
+        }
+        closedir(dir);
+
+        std::sort(roms.begin(), roms.end());
+
+        return roms;
+    }
+
+    std::FILE* list = std::fopen(source.c_str(), "r");
+    if (!list) {
+        return roms;
+    }
+
+    char line[4096];
+    while (std::fgets(line, sizeof(line), list)) {
+        line[std::strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0') {
+            roms.push_back(line);
+        }
+    }
+    std::fclose(list);
+
+    return roms;
+}
+
+static std::string json_escape(const std::string& text)
+{
+    std::string out;
+    for (unsigned char c : text) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            if (c < 0x20 || c >= 0x7F) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += (char) c;
+            }
+        }
+    }
+
+    return out;
+}
+
+struct BatchResult {
+    const char* status;
+    uint64_t frameHash;
+    uint64_t cycles;
+    std::string serial;
+    double wallMs;
+};
+
+static BatchResult run_rom(const std::string& path, int frames)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    BatchResult result = { "ok", 0, 0, "", 0.0 };
+
+    yb::Cartridge cartridge = yb::read_cartridge(path.c_str());
+    if (cartridge.empty()) {
+        result.status = "unreadable";
+    } else if (!cartridge.isSupported()) {
+        result.status = "unsupported";
+    } else {
+        yb::Emulator emulator(std::move(cartridge), true);
+        for (int i = 0; i < frames && !emulator.isLocked(); ++i) {
+            emulator.runFrame();
+        }
+
+        if (emulator.isLocked()) {
+            result.status = "locked";
+        }
+        result.frameHash = emulator.frameHash();
+        result.cycles = emulator.cycles();
+        result.serial = emulator.serial();
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    result.wallMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+    return result;
+}
+
+} // end namespace
+
+int yb::run_batch(const std::string& source, int frames, int jobs)
+{
+    const std::vector<std::string> roms = list_roms(source);
+    if (roms.empty()) {
+        yb::error("No ROMs found in %s.\n", source.c_str());
+        return 1;
+    }
+
+    // per-instruction tracing from thousands of machines would only be noise
+    yb::log_enabled() = false;
+
+    std::mutex outputMutex;
+    int failures = 0;
+
+    {
+        yb::ThreadPool pool(jobs);
+        for (const std::string& rom : roms) {
+            pool.submit([&, rom] {
+                const BatchResult result = run_rom(rom, frames);
+
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::printf(
+                    "{\"rom\":\"%s\",\"status\":\"%s\",\"frames\":%d,\"frame_hash\":\"%016llx\","
+                    "\"cycles\":%llu,\"serial\":\"%s\",\"wall_ms\":%.3f}\n",
+                    json_escape(rom).c_str(),
+                    result.status,
+                    frames,
+                    (unsigned long long) result.frameHash,
+                    (unsigned long long) result.cycles,
+                    json_escape(result.serial).c_str(),
+                    result.wallMs
+                );
+                std::fflush(stdout);
+
+                if (std::strcmp(result.status, "ok") != 0) {
+                    ++failures;
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    return failures;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+namespace yb {
+
+    // Runs every ROM in a directory (or listed one path per line in a file) headlessly
+    // for the given number of frames on a work-stealing thread pool, printing one JSON
+    // line per ROM to stdout. Zero jobs uses every core.
+    // Returns the number of ROMs that could not be run to completion.
+    int run_batch(const std::string& source, int frames, int jobs);
+
+}
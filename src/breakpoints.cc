@@ -0,0 +1,49 @@
+#include "breakpoints.h"
+
+#include <cstring>
+
+yb::BreakpointSet::BreakpointSet()
+{
+    std::memset(pages_, 0, sizeof(pages_));
+}
+
+bool yb::BreakpointSet::add(uint16_t addr)
+{
+    if (!addrs_.insert(addr).second) {
+        return false;
+    }
+
+    ++pages_[addr >> YB_PAGE_SHIFT];
+    return true;
+}
+
+bool yb::BreakpointSet::remove(uint16_t addr)
+{
+    if (addrs_.erase(addr) == 0) {
+        return false;
+    }
+
+    --pages_[addr >> YB_PAGE_SHIFT];
+    return true;
+}
+
+void yb::BreakpointSet::clear()
+{
+    addrs_.clear();
+    std::memset(pages_, 0, sizeof(pages_));
+}
+
+bool yb::BreakpointSet::contains(uint16_t addr) const
+{
+    return pages_[addr >> YB_PAGE_SHIFT] != 0 && addrs_.count(addr) != 0;
+}
+
+bool yb::BreakpointSet::empty() const
+{
+    return addrs_.empty();
+}
+
+const std::set<uint16_t>& yb::BreakpointSet::addresses() const
+{
+    return addrs_;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+
+#include "mmu.h"
+
+namespace yb {
+
+    // Execution breakpoints with a per-page count in front of the exact lookup,
+    // so checking a PC outside of any breakpoint's page is a single array read.
+    class BreakpointSet
+    {
+    public:
+        BreakpointSet();
+
+        // Return true if the set changed.
+        bool add(uint16_t addr);
+        bool remove(uint16_t addr);
+        void clear();
+
+        bool contains(uint16_t addr) const;
+        bool empty() const;
+
+        const std::set<uint16_t>& addresses() const;
+
+    private:
+        std::set<uint16_t> addrs_;
+        uint16_t pages_[YB_PAGE_COUNT];
+    };
+
+}
@@ -2,39 +2,171 @@
 
 #include <cstdio>
 #include <cstring>
+#include <mutex>
+#include <unordered_map>
 
 #include "common.h"
+#include "hash.h"
+
+// The MMU maps the first two ROM banks unconditionally.
+static constexpr size_t MIN_ROM_SIZE = 0x8000;
+
+using RomImage = std::vector<std::uint8_t>;
+
+// Returns the image already loaded with the same bytes, if any is still
+// alive, or a new one. Images are looked up by content hash and only held
+// weakly, so they go away with the last cartridge using them.
+static std::shared_ptr<const RomImage> intern(RomImage mem)
+{
+    static std::mutex mutex;
+    static std::unordered_multimap<uint64_t, std::weak_ptr<const RomImage>> images;
+
+    if (mem.empty()) {
+        return std::make_shared<const RomImage>();
+    }
+
+    const uint64_t key = yb::hash64(mem.data(), mem.size());
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto range = images.equal_range(key);
+    for (auto it = range.first; it != range.second; ) {
+        std::shared_ptr<const RomImage> image = it->second.lock();
+        if (!image) {
+            it = images.erase(it);
+            continue;
+        }
+        if (*image == mem) {
+            return image;
+        }
+        ++it;
+    }
+
+    auto image = std::make_shared<const RomImage>(std::move(mem));
+    images.emplace(key, image);
+
+    return image;
+}
 
 yb::Cartridge::Cartridge(std::vector<std::uint8_t> mem)
-    : mem_(std::move(mem))
+    : mem_(intern(std::move(mem)))
+    , type_(yb::CartridgeType::ROM_ONLY)
 {
+    const RomImage& rom = *mem_;
+    if (rom.size() < MIN_ROM_SIZE) {
+        return;
+    }
+
     {
         char title[16 + 1] = {0};
-        std::memcpy(title, (char*) mem_.data() + 0x134, 16);
-        std::printf("Title: %s\n", title);
+        std::memcpy(title, (const char*) rom.data() + 0x134, 16);
+        yb::log("Title: %s\n", title);
     }
 
-    type_ = (yb::CartridgeType) mem_[0x147];
+    type_ = (yb::CartridgeType) rom[0x147];
+
+    yb::log("Catridge Type: %d\n", (int) type_);
+    yb::log("CGB: %s\n", isCGB() ? ((rom[0x143] & 0x40) ? "only" : "yes") : "no");
+}
+
+bool yb::Cartridge::empty() const
+{
+    return mem_->empty();
+}
 
+bool yb::Cartridge::isSupported() const
+{
     // TODO: support other cartridge types
-    if (type_ != yb::CartridgeType::ROM_ONLY) {
-        yb::exit("ROM_ONLY cartridge is currently supported.\n");
-    }
+    const bool mapped = type_ == yb::CartridgeType::ROM_ONLY
+        || type_ == yb::CartridgeType::ROM_RAM
+        || type_ == yb::CartridgeType::ROM_RAM_BATTERY;
 
-    std::printf("Catridge Type: %d\n", (int) type_);
+    return mem_->size() >= MIN_ROM_SIZE && mapped;
 }
 
-bool yb::Cartridge::empty() const
+const uint8_t* yb::Cartridge::data() const
 {
-    return mem_.empty();
+    return mem_->data();
 }
 
-uint8_t* yb::Cartridge::data()
+size_t yb::Cartridge::size() const
 {
-    return mem_.data();
+    return mem_->size();
 }
 
 yb::CartridgeType yb::Cartridge::type() const
 {
     return type_;
 }
+
+size_t yb::Cartridge::ramSize() const
+{
+    static constexpr size_t SIZES[] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+
+    const RomImage& rom = *mem_;
+    if (rom.size() <= 0x149 || rom[0x149] >= sizeof(SIZES) / sizeof(SIZES[0])) {
+        return 0;
+    }
+
+    return SIZES[rom[0x149]];
+}
+
+bool yb::Cartridge::hasBattery() const
+{
+    switch ((int) type_) {
+    case 0x03: // MBC1+RAM+BATTERY
+    case 0x06: // MBC2+BATTERY
+    case 0x09: // ROM+RAM+BATTERY
+    case 0x0D: // MMM01+RAM+BATTERY
+    case 0x0F: // MBC3+TIMER+BATTERY
+    case 0x10: // MBC3+TIMER+RAM+BATTERY
+    case 0x13: // MBC3+RAM+BATTERY
+    case 0x1B: // MBC5+RAM+BATTERY
+    case 0x1E: // MBC5+RUMBLE+RAM+BATTERY
+    case 0x22: // MBC7+SENSOR+RUMBLE+RAM+BATTERY
+    case 0xFF: // HuC1+RAM+BATTERY
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool yb::Cartridge::isCGB() const
+{
+    return mem_->size() > 0x143 && ((*mem_)[0x143] & 0x80) != 0;
+}
+
+static size_t fsize(std::FILE *file)
+{
+    size_t curr = std::ftell(file);
+    std::fseek(file, 0, SEEK_END);
+
+    size_t size = std::ftell(file);
+
+    std::fseek(file, curr, SEEK_SET);
+
+    return size;
+}
+
+yb::Cartridge yb::read_cartridge(const char* path)
+{
+    std::FILE *file = std::fopen(path, "rb");
+    if (!file) {
+        return std::vector<std::uint8_t>{};
+    }
+
+    size_t fileSize = fsize(file);
+
+    std::vector<std::uint8_t> mem(fileSize, 0);
+
+    size_t bytesRead = std::fread(mem.data(), sizeof(uint8_t), fileSize, file);
+    if (bytesRead != fileSize) {
+        std::fclose(file);
+
+        return std::vector<std::uint8_t>{};
+    }
+
+    std::fclose(file);
+
+    return mem;
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <memory>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 
 namespace yb {
@@ -9,9 +11,15 @@ namespace yb {
     enum class CartridgeType
     {
         ROM_ONLY = 0,
-        ROM_MBC1
+        ROM_MBC1 = 1,
+        // up to 8KB of RAM at 0xA000 and no bank controller
+        ROM_RAM = 8,
+        ROM_RAM_BATTERY = 9
     };
 
+    // The ROM image is read only and shared: copies of a cartridge, and
+    // cartridges made from the same bytes anywhere in the process, all point
+    // at one reference counted image.
     struct Cartridge
     {
     public:
@@ -19,12 +27,31 @@ namespace yb {
         
         bool empty() const;
 
-        uint8_t* data();
+        // True if the image is large enough to map and of a supported type.
+        bool isSupported() const;
+
+        const uint8_t* data() const;
+
+        // Size of the ROM image in bytes.
+        size_t size() const;
 
         CartridgeType type() const;
 
+        // Bytes of external RAM the header (0x149) declares.
+        size_t ramSize() const;
+
+        // True if the cartridge type has a battery keeping its RAM.
+        bool hasBattery() const;
+
+        // True if the header's CGB flag (0x143) marks the game as using Game Boy
+        // Color features, whether or not it also runs on a DMG.
+        bool isCGB() const;
+
     private:
-        std::vector<std::uint8_t> mem_;
+        std::shared_ptr<const std::vector<std::uint8_t>> mem_;
         CartridgeType type_;
     };
+
+    // Returns an empty cartridge if the file could not be read.
+    Cartridge read_cartridge(const char* path);
 }
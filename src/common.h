@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 
@@ -7,6 +8,20 @@
 
 namespace yb {
 
+    // Global switch for yb::log output. Speculative and headless runs turn it off
+    // so the log only reflects emulation the user actually sees; builds without a
+    // window (the library and the test harness) start with it off. Atomic since
+    // library instances may run on several threads.
+    inline std::atomic<bool>& log_enabled()
+    {
+#ifdef YB_NO_WINDOW
+        static std::atomic<bool> enabled(false);
+#else
+        static std::atomic<bool> enabled(true);
+#endif
+        return enabled;
+    }
+
     template <class... Args>
     inline void error(const char *msg, Args&&... args)
     {
@@ -34,11 +49,17 @@ namespace yb {
     template <class... Args>
     inline void log(const char *msg, Args&&... args)
     {
+        if (!log_enabled()) {
+            return;
+        }
         std::printf(msg, std::forward<Args>(args)...);
     }
 
     inline void log(const char *msg)
     {
+        if (!log_enabled()) {
+            return;
+        }
         std::puts(msg);
     }
 
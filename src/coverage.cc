@@ -0,0 +1,132 @@
+#include "coverage.h"
+
+#include <algorithm>
+#include <bitset>
+#include <string>
+
+#include "common.h"
+#include "disasm.h"
+#include "ops.h"
+
+namespace yb {
+
+static uint16_t address_of(uint32_t offset)
+{
+    const uint32_t bank = offset / yb::Coverage::BANK_SIZE;
+    const uint32_t inBank = offset % yb::Coverage::BANK_SIZE;
+    return (uint16_t)(bank == 0 ? inBank : yb::Coverage::BANK_SIZE + inBank);
+}
+
+static bool is_padding(const uint8_t* rom, uint32_t begin, uint32_t end)
+{
+    for (uint32_t i = begin; i < end; ++i) {
+        if (rom[i] != rom[begin] || (rom[i] != 0x00 && rom[i] != 0xFF)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // end namespace
+
+yb::Coverage::Coverage(const yb::Cartridge& cartridge)
+    : rom_(cartridge.data())
+    , size_((uint32_t) cartridge.size())
+    , bits_((cartridge.size() + 63) / 64, 0)
+{
+    // unknown opcodes still occupy their byte
+    for (int op = 0; op < 256; ++op) {
+        const auto it = yb::INSTRUCTIONS.find((uint8_t) op);
+        lengths_[op] = it != yb::INSTRUCTIONS.end() && it->second.length > 0 ? it->second.length : 1;
+    }
+    lengths_[0xCB] = 2;
+}
+
+void yb::Coverage::onInstruction(const yb::CPU& cpu, const yb::Step& step)
+{
+    YB_UNUSED(cpu);
+
+    if (step.pc >= 2 * BANK_SIZE) {
+        return;
+    }
+
+    const uint32_t offset = step.bank * BANK_SIZE + (step.pc & (BANK_SIZE - 1));
+    for (uint32_t i = offset; i < offset + lengths_[step.op] && i < size_; ++i) {
+        bits_[i >> 6] |= (uint64_t) 1 << (i & 63);
+    }
+}
+
+bool yb::Coverage::executed(uint32_t offset) const
+{
+    return offset < size_ && (bits_[offset >> 6] >> (offset & 63)) & 1;
+}
+
+void yb::Coverage::report(std::FILE* out, const yb::SymbolTable& symbols, int listing) const
+{
+    const uint32_t banks = (size_ + BANK_SIZE - 1) / BANK_SIZE;
+
+    uint64_t total = 0;
+    for (uint32_t bank = 0; bank < banks; ++bank) {
+        const uint32_t begin = bank * BANK_SIZE;
+        const uint32_t end = std::min(size_, begin + BANK_SIZE);
+
+        // banks are whole words of the bitmap
+        uint32_t count = 0;
+        for (uint32_t word = begin / 64; word < (end + 63) / 64; ++word) {
+            count += std::bitset<64>(bits_[word]).count();
+        }
+        total += count;
+
+        std::fprintf(out, "bank %02X: %5u/%u bytes executed (%.1f%%)\n",
+            bank, count, end - begin, 100.0 * count / (end - begin));
+    }
+    std::fprintf(out, "total:   %llu/%u bytes executed (%.1f%%)\n",
+        (unsigned long long) total, size_, size_ ? 100.0 * total / size_ : 0.0);
+
+    std::fputs("\nNever executed:\n", out);
+
+    uint32_t offset = 0;
+    while (offset < size_) {
+        if (executed(offset)) {
+            ++offset;
+            continue;
+        }
+
+        // ranges stop at bank boundaries so every address is unambiguous
+        const uint32_t bankEnd = std::min(size_, (offset / BANK_SIZE + 1) * BANK_SIZE);
+        uint32_t end = offset;
+        while (end < bankEnd && !executed(end)) {
+            ++end;
+        }
+
+        if (!is_padding(rom_, offset, end)) {
+            const uint8_t bank = (uint8_t)(offset / BANK_SIZE);
+            std::fprintf(out, "%02X:%04X-%02X:%04X (%u bytes)",
+                bank, address_of(offset), bank, address_of(end - 1), end - offset);
+            if (symbols.lookup(bank, address_of(offset))) {
+                std::fprintf(out, " %s", symbols.describe(bank, address_of(offset)).c_str());
+            }
+            std::fputc('\n', out);
+
+            std::string text;
+            uint32_t at = offset;
+            for (int line = 0; line < listing && at < end; ++line) {
+                const uint8_t bytes[3] = {
+                    rom_[at],
+                    at + 1 < size_ ? rom_[at + 1] : (uint8_t) 0,
+                    at + 2 < size_ ? rom_[at + 2] : (uint8_t) 0
+                };
+                const uint8_t length = yb::disassemble(address_of(at), bytes, text);
+
+                std::fprintf(out, "    %04X  %s\n", address_of(at), text.c_str());
+                at += length;
+            }
+            if (at < end) {
+                std::fputs("    ...\n", out);
+            }
+        }
+
+        offset = end;
+    }
+}
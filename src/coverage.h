@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "cartridge.h"
+#include "hook.h"
+#include "symbols.h"
+
+namespace yb {
+
+    // Records which ROM bytes were executed, one bit per byte of the cartridge
+    // image, indexed by ROM offset (bank * 0x4000 + offset in bank). Code run
+    // from RAM is not tracked.
+    class Coverage : public yb::InstructionHook
+    {
+    public:
+        static constexpr uint32_t BANK_SIZE = 0x4000;
+
+        // The cartridge must outlive the coverage.
+        Coverage(const yb::Cartridge& cartridge);
+
+        void onInstruction(const yb::CPU& cpu, const yb::Step& step) override;
+
+        // True if the byte at the given ROM offset was part of an executed instruction.
+        bool executed(uint32_t offset) const;
+
+        // Writes the executed share of every bank followed by every range that
+        // never ran, each with its first listing instructions disassembled.
+        // Ranges made only of 0x00 or 0xFF padding are left out.
+        void report(std::FILE* out, const yb::SymbolTable& symbols, int listing = 8) const;
+
+    private:
+        const uint8_t* rom_;
+        uint32_t size_;
+
+        std::vector<uint64_t> bits_;
+        uint8_t lengths_[256];
+    };
+
+}
@@ -1,6 +1,8 @@
 #include "cpu.h"
 
+#include <chrono>
 #include <cstdio>
+#include <vector>
 
 #include "ops.h"
 #include "common.h"
@@ -220,29 +222,158 @@ static uint16_t add16(yb::CPU* cpu, uint16_t a, uint16_t b)
     return result;
 }
 
+// Instructions by opcode, null where there is none. Decoding depends on
+// nothing but the opcode, so a single table, built on first use, serves every
+// CPU in the process whatever memory its code runs from.
+struct DecodeTable
+{
+    const yb::Instruction* ops[256];
+    const yb::Instruction* prefixed[256];
+
+    DecodeTable()
+    {
+        for (int op = 0; op < 256; ++op) {
+            const auto it = yb::INSTRUCTIONS.find((uint8_t) op);
+            ops[op] = it != yb::INSTRUCTIONS.end() ? &it->second : nullptr;
+
+            const auto prefix = yb::PREFIXED_INSTRUCTIONS.find((uint8_t) op);
+            prefixed[op] = prefix != yb::PREFIXED_INSTRUCTIONS.end() ? &prefix->second : nullptr;
+        }
+    }
+};
+
+static const DecodeTable& decode_table()
+{
+    static const DecodeTable table;
+    return table;
+}
+
 } // end namespace
 
 yb::CPU::CPU(yb::MMU* mmu)
     : mmu_(mmu)
+    , decode_(&yb::decode_table())
+    , locked_(false)
 {
-    AF.value = 0x01B0;
-    BC.value = 0x0013;
-    DE.value = 0x00D8;
-    HL.value = 0x014D;
+    // what the boot ROM leaves behind; A = 0x11 is how games detect a CGB
+    if (mmu_->isCGB()) {
+        AF.value = 0x1180;
+        BC.value = 0x0000;
+        DE.value = 0xFF56;
+        HL.value = 0x000D;
+    } else {
+        AF.value = 0x01B0;
+        BC.value = 0x0013;
+        DE.value = 0x00D8;
+        HL.value = 0x014D;
+    }
     SP.value = 0xFFFE;
 
     // TODO: verify this value
     PC.value = 0x100;
 }
 
+void yb::CPU::save(yb::StateWriter& writer) const
+{
+    writer.write16(AF.value);
+    writer.write16(BC.value);
+    writer.write16(DE.value);
+    writer.write16(HL.value);
+    writer.write16(SP.value);
+    writer.write16(PC.value);
+    writer.write8(locked_);
+
+    // the stack is written bottom to top so it can be rebuilt by pushing in order
+    std::stack<uint16_t> st = st_;
+    std::vector<uint16_t> values;
+    while (!st.empty()) {
+        values.push_back(st.top());
+        st.pop();
+    }
+
+    writer.write32(values.size());
+    for (auto it = values.rbegin(); it != values.rend(); ++it) {
+        writer.write16(*it);
+    }
+}
+
+void yb::CPU::load(yb::StateReader& reader)
+{
+    AF.value = reader.read16();
+    BC.value = reader.read16();
+    DE.value = reader.read16();
+    HL.value = reader.read16();
+    SP.value = reader.read16();
+    PC.value = reader.read16();
+    locked_ = reader.read8() != 0;
+
+    st_ = std::stack<uint16_t>();
+    const uint32_t size = reader.read32();
+    for (uint32_t i = 0; i < size && reader.ok(); ++i) {
+        st_.push(reader.read16());
+    }
+}
+
+#ifdef YB_PROFILE
+const yb::OpcodeProfile& yb::CPU::profile() const
+{
+    return profile_;
+}
+#endif
+
+bool yb::CPU::isLocked() const
+{
+    return locked_;
+}
+
+// Like the hardware on an illegal opcode, the CPU hangs: PC stays put and time
+// keeps passing so the rest of the machine (and the caller's frame loop) runs on.
+uint8_t yb::CPU::lockup(const char* msg, uint8_t op)
+{
+    if (!locked_) {
+        yb::error(msg, op);
+        locked_ = true;
+    }
+
+    return 4;
+}
+
 uint8_t yb::CPU::tick()
 {
     // fetch
    uint8_t op = mmu_->read8(PC.value);
    yb::log("Fetching from 0x%.4X: 0x%.2X.\n", PC.value, op);
 
+#ifdef YB_PROFILE
+   const bool sampled = profile_.shouldSample();
+   const auto start = sampled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+   // peeked before the instruction runs: a CPU read could hit a watchpoint or
+   // the OAM DMA lockout, and the instruction could overwrite the byte
+   const uint16_t key = op == 0xCB ? 0x100 | mmu_->peek8(PC.value + 1) : op;
+
+   const uint8_t cycles = execute(op);
+
+   const auto end = sampled ? std::chrono::steady_clock::now() : start;
+   profile_.record(key, cycles);
+   if (sampled) {
+       profile_.sample(key, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+   }
+
+   return cycles;
+#else
+   return execute(op);
+#endif
+}
+
+uint8_t yb::CPU::execute(uint8_t op)
+{
    // decode
-   const yb::Instruction& inst = yb::INSTRUCTIONS.at(op);
+   const yb::Instruction* decoded = decode_->ops[op];
+   if (!decoded) {
+       return lockup("Illegal instruction 0x%.2X.\n", op);
+   }
+   const yb::Instruction& inst = *decoded;
 
    // execute
    switch (op) {
@@ -1049,6 +1180,13 @@ uint8_t yb::CPU::tick()
         }
         return inst.cycles;
     }
+    // STOP
+    case 0x10:
+        // Only the CGB speed switch is emulated. Without one armed the CPU
+        // would sleep until a button is pressed; here it carries on.
+        mmu_->switchSpeed();
+        PC.value += inst.length;
+        return inst.cycles;
     // DI
     case 0xF3:
         // TODO: disable interrupt
@@ -1196,15 +1334,14 @@ uint8_t yb::CPU::tick()
         PC.value += inst.length;
         return inst.cycles;        
     default:
-        yb::exit("Unknown instruction 0x%.2X.\n", op);
-        return 0;
+        return lockup("Unknown instruction 0x%.2X.\n", op);
    }
 }
 
 uint8_t yb::CPU::execute_prefix()
 {
     const uint8_t op = mmu_->read8(PC.value);
-    const Instruction& inst = yb::PREFIXED_INSTRUCTIONS.at(op);
+    const Instruction& inst = *decode_->prefixed[op];
     switch (op) {
     // SWAP n
     case 0x37:
@@ -1242,7 +1379,8 @@ uint8_t yb::CPU::execute_prefix()
         return inst.cycles;
     }
     default:
-        yb::exit("Unknown PREFIX instruction 0x%.2X.\n", op);
-        return 0;
+        // point back at the 0xCB prefix so the CPU stays hung on this instruction
+        PC.value -= 1;
+        return lockup("Unknown PREFIX instruction 0x%.2X.\n", op);
     }
 }
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include "mmu.h"
+#include "profiler.h"
+#include "savestate.h"
 #include <stack>
 
 namespace yb {
@@ -18,12 +20,24 @@ namespace yb {
         };
     };
 
+    struct DecodeTable;
+
     class CPU
     {
     public:
         CPU(yb::MMU* mmu);
 
         uint8_t tick();
+
+#ifdef YB_PROFILE
+        const yb::OpcodeProfile& profile() const;
+#endif
+
+        // True once the CPU hit an instruction it cannot execute.
+        bool isLocked() const;
+
+        void save(yb::StateWriter& writer) const;
+        void load(yb::StateReader& reader);
     
         Register AF;
         Register BC;
@@ -35,8 +49,17 @@ namespace yb {
 
     private:
         yb::MMU* mmu_;
+        const yb::DecodeTable* decode_;
         std::stack<uint16_t> st_;
+        bool locked_;
+
+#ifdef YB_PROFILE
+        yb::OpcodeProfile profile_;
+#endif
 
+        uint8_t execute(uint8_t op);
         uint8_t execute_prefix();
+
+        uint8_t lockup(const char* msg, uint8_t op);
     };
 }
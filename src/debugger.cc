@@ -0,0 +1,370 @@
+#include "debugger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "common.h"
+#include "disasm.h"
+
+namespace yb {
+
+static constexpr uint8_t ZF = (1 << 7);
+static constexpr uint8_t NF = (1 << 6);
+static constexpr uint8_t HF = (1 << 5);
+static constexpr uint8_t CF = (1 << 4);
+
+static volatile std::sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int)
+{
+    interrupted = 1;
+}
+
+// Accepts $1234, 0x1234 and plain hex.
+static bool parse_address(const std::string& text, uint16_t& addr)
+{
+    const char* digits = text.c_str();
+    if (digits[0] == '$') {
+        digits += 1;
+    } else if (digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+        digits += 2;
+    }
+
+    char* end = nullptr;
+    const unsigned long value = std::strtoul(digits, &end, 16);
+    if (*digits == '\0' || *end != '\0' || value > 0xFFFF) {
+        return false;
+    }
+
+    addr = (uint16_t) value;
+    return true;
+}
+
+static void print_help()
+{
+    std::puts("step|s [N]          execute N instructions (default 1)");
+    std::puts("continue|c          resume execution");
+    std::puts("break|b ADDR        break before executing ADDR");
+    std::puts("watch ADDR          break after writes to ADDR");
+    std::puts("rwatch ADDR         break after reads of ADDR");
+    std::puts("awatch ADDR         break after reads of or writes to ADDR");
+    std::puts("delete|d ADDR       remove the breakpoint and watchpoints at ADDR");
+    std::puts("info|i              list breakpoints and watchpoints");
+    std::puts("regs|r              show the registers");
+    std::puts("x ADDR [N]          dump N bytes of memory (default 64)");
+    std::puts("disas|l [ADDR] [N]  disassemble N instructions (default: 10 from PC)");
+    std::puts("quit|q              stop emulation");
+    std::puts("An empty line repeats the last command.");
+}
+
+} // end namespace
+
+yb::Debugger::Debugger(yb::Emulator* emulator)
+    : emulator_(emulator)
+    , watchHit_(false)
+    , stopCycle_(0)
+    , stepsLeft_(0)
+    , hooked_(false)
+    , quit_(false)
+{
+    emulator_->addFrameHook(this);
+    emulator_->addExecHook(this);
+    emulator_->mmu().setWatchListener(this);
+
+    std::signal(SIGINT, on_interrupt);
+}
+
+yb::Debugger::~Debugger()
+{
+    std::signal(SIGINT, SIG_DFL);
+
+    for (const auto& watchpoint : watchpoints_) {
+        emulator_->mmu().unwatch(watchpoint.first, watchpoint.second);
+    }
+    emulator_->mmu().setWatchListener(nullptr);
+
+    for (uint16_t addr : breakpoints_.addresses()) {
+        emulator_->unwatchExec(addr);
+    }
+    emulator_->removeExecHook(this);
+
+    emulator_->removeFrameHook(this);
+    emulator_->cancelBreak(this);
+    if (hooked_) {
+        emulator_->removeHook(this);
+    }
+}
+
+void yb::Debugger::addBreakpoint(uint16_t addr)
+{
+    if (breakpoints_.add(addr)) {
+        emulator_->watchExec(addr);
+    }
+}
+
+void yb::Debugger::removeBreakpoint(uint16_t addr)
+{
+    if (breakpoints_.remove(addr)) {
+        emulator_->unwatchExec(addr);
+    }
+}
+
+void yb::Debugger::addWatchpoint(uint16_t addr, uint8_t flags)
+{
+    watchpoints_[addr] |= flags;
+    emulator_->mmu().watch(addr, flags);
+}
+
+void yb::Debugger::removeWatchpoint(uint16_t addr)
+{
+    const auto watchpoint = watchpoints_.find(addr);
+    if (watchpoint != watchpoints_.end()) {
+        emulator_->mmu().unwatch(addr, watchpoint->second);
+        watchpoints_.erase(watchpoint);
+    }
+}
+
+void yb::Debugger::onInstruction(const yb::CPU& cpu, const yb::Step& step)
+{
+    YB_UNUSED(step);
+
+    bool stop = false;
+
+    if (watchHit_) {
+        std::fputs(watchMessage_.c_str(), stdout);
+        watchHit_ = false;
+        stop = true;
+    }
+
+    if (stepsLeft_ > 0 && --stepsLeft_ == 0) {
+        stop = true;
+    }
+
+    // onExec() won't stop again for a breakpoint stepped onto
+    const uint16_t pc = cpu.PC.value;
+    if (stop && breakpoints_.contains(pc)) {
+        std::printf("Breakpoint at $%04X.\n", pc);
+    }
+
+    if (stop) {
+        prompt();
+    }
+}
+
+void yb::Debugger::onFrame()
+{
+    if (interrupted) {
+        interrupted = 0;
+        std::puts("\nInterrupted.");
+        prompt();
+    }
+}
+
+void yb::Debugger::onExec(uint16_t pc)
+{
+    // a step or watchpoint may have stopped here already
+    if (!quit_ && breakpoints_.contains(pc) && emulator_->cycles() != stopCycle_) {
+        std::printf("Breakpoint at $%04X.\n", pc);
+        prompt();
+    }
+}
+
+void yb::Debugger::onBreak()
+{
+    // the instruction hook may have stopped for the watchpoint already
+    if (watchHit_ && !quit_) {
+        std::fputs(watchMessage_.c_str(), stdout);
+        watchHit_ = false;
+        prompt();
+    }
+}
+
+void yb::Debugger::onWatch(uint16_t addr, uint8_t value, bool write)
+{
+    char message[64];
+    std::snprintf(message, sizeof(message), "Watchpoint: %s $%04X (value $%02X).\n", write ? "write to" : "read of", addr, value);
+
+    watchMessage_ += message;
+    if (!watchHit_) {
+        watchHit_ = true;
+        emulator_->requestBreak(this);
+    }
+}
+
+void yb::Debugger::prompt()
+{
+    stopCycle_ = emulator_->cycles();
+    stepsLeft_ = 0;
+    watchHit_ = false;
+    watchMessage_.clear();
+
+    printDisassembly(emulator_->cpu().PC.value, 1);
+
+    char line[256];
+    for (;;) {
+        std::fputs("(yb) ", stdout);
+        std::fflush(stdout);
+
+        if (!std::fgets(line, sizeof(line), stdin)) {
+            // no more commands can come
+            std::putchar('\n');
+            execute("quit");
+            break;
+        }
+        line[std::strcspn(line, "\r\n")] = '\0';
+
+        std::string command = line;
+        if (command.empty()) {
+            command = lastCommand_;
+        }
+        lastCommand_ = command;
+
+        if (execute(command)) {
+            break;
+        }
+    }
+
+    updateHook();
+}
+
+bool yb::Debugger::execute(const std::string& line)
+{
+    std::istringstream in(line);
+    std::string command;
+    std::string arg1;
+    std::string arg2;
+    in >> command >> arg1 >> arg2;
+
+    uint16_t addr = 0;
+    const bool hasAddr = parse_address(arg1, addr);
+
+    if (command.empty()) {
+        return false;
+    }
+    else if (command == "s" || command == "step") {
+        const int count = arg1.empty() ? 1 : std::atoi(arg1.c_str());
+        stepsLeft_ = count > 0 ? count : 1;
+        return true;
+    }
+    else if (command == "c" || command == "continue") {
+        return true;
+    }
+    else if ((command == "b" || command == "break") && hasAddr) {
+        addBreakpoint(addr);
+    }
+    else if (command == "watch" && hasAddr) {
+        addWatchpoint(addr, WATCH_WRITE);
+    }
+    else if (command == "rwatch" && hasAddr) {
+        addWatchpoint(addr, WATCH_READ);
+    }
+    else if (command == "awatch" && hasAddr) {
+        addWatchpoint(addr, WATCH_READ | WATCH_WRITE);
+    }
+    else if ((command == "d" || command == "delete") && hasAddr) {
+        removeBreakpoint(addr);
+        removeWatchpoint(addr);
+    }
+    else if (command == "i" || command == "info") {
+        printPoints();
+    }
+    else if (command == "r" || command == "regs") {
+        printRegisters();
+    }
+    else if (command == "x" && hasAddr) {
+        printMemory(addr, arg2.empty() ? 64 : std::atoi(arg2.c_str()));
+    }
+    else if (command == "l" || command == "disas") {
+        const uint16_t from = hasAddr ? addr : emulator_->cpu().PC.value;
+        printDisassembly(from, arg2.empty() ? 10 : std::atoi(arg2.c_str()));
+    }
+    else if (command == "q" || command == "quit") {
+        emulator_->stop();
+        quit_ = true;
+        return true;
+    }
+    else if (command == "h" || command == "help") {
+        print_help();
+    }
+    else {
+        std::printf("Unknown command or bad arguments: %s (try 'help').\n", line.c_str());
+    }
+
+    return false;
+}
+
+void yb::Debugger::printRegisters() const
+{
+    const yb::CPU& cpu = emulator_->cpu();
+    const uint8_t f = cpu.AF.lo;
+
+    std::printf("AF=$%04X BC=$%04X DE=$%04X HL=$%04X SP=$%04X PC=$%04X  [%c%c%c%c]  cycles=%llu\n",
+        cpu.AF.value, cpu.BC.value, cpu.DE.value, cpu.HL.value, cpu.SP.value, cpu.PC.value,
+        (f & ZF) ? 'Z' : '-', (f & NF) ? 'N' : '-', (f & HF) ? 'H' : '-', (f & CF) ? 'C' : '-',
+        (unsigned long long) emulator_->cycles());
+}
+
+void yb::Debugger::printMemory(uint16_t addr, int count) const
+{
+    const yb::MMU& mmu = emulator_->mmu();
+
+    for (int row = 0; row < count; row += 16) {
+        std::printf("$%04X:", (uint16_t)(addr + row));
+        for (int i = row; i < row + 16 && i < count; ++i) {
+            // peek at the backing memory so dumps don't trip read watchpoints
+            std::printf(" %02X", mmu.peek8(addr + i));
+        }
+        std::putchar('\n');
+    }
+}
+
+void yb::Debugger::printDisassembly(uint16_t addr, int count) const
+{
+    const yb::MMU& mmu = emulator_->mmu();
+    const uint16_t pc = emulator_->cpu().PC.value;
+
+    std::string text;
+    for (int i = 0; i < count; ++i) {
+        const uint8_t bytes[3] = { mmu.peek8(addr), mmu.peek8(addr + 1), mmu.peek8(addr + 2) };
+        const uint8_t length = yb::disassemble(addr, bytes, text);
+
+        std::printf("%s $%04X: %-16s", addr == pc ? "=>" : "  ", addr, text.c_str());
+        for (uint8_t b = 0; b < length; ++b) {
+            std::printf(" %02X", bytes[b]);
+        }
+        std::putchar('\n');
+
+        addr += length;
+    }
+}
+
+void yb::Debugger::printPoints() const
+{
+    for (uint16_t addr : breakpoints_.addresses()) {
+        std::printf("breakpoint $%04X\n", addr);
+    }
+
+    for (const auto& watchpoint : watchpoints_) {
+        const bool read = watchpoint.second & WATCH_READ;
+        const bool write = watchpoint.second & WATCH_WRITE;
+        std::printf("%s $%04X\n", read && write ? "awatch" : read ? "rwatch" : "watch", watchpoint.first);
+    }
+}
+
+void yb::Debugger::updateHook()
+{
+    // after quitting, let the rest of the frame finish on the fast path
+    const bool wanted = !quit_ && stepsLeft_ > 0;
+    if (wanted == hooked_) {
+        return;
+    }
+
+    if (wanted) {
+        emulator_->addHook(this);
+    } else {
+        emulator_->removeHook(this);
+    }
+    hooked_ = wanted;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <csignal>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "breakpoints.h"
+#include "emulator.h"
+#include "hook.h"
+#include "mmu.h"
+
+namespace yb {
+
+    // Interactive command line debugger.
+    //
+    // Watchpoints only move the pages containing them off the MMU fast path and
+    // stop through Emulator::requestBreak(). Breakpoints are exec watches, which
+    // the frame loop tests with one read of PC's page. Only single steps
+    // install the instruction hook.
+    // Ctrl-C breaks into the prompt at the next frame boundary.
+    class Debugger : public yb::InstructionHook, public yb::FrameHook, public yb::ExecHook, public yb::BreakHook, public yb::WatchListener
+    {
+    public:
+        Debugger(yb::Emulator* emulator);
+        ~Debugger();
+
+        void addBreakpoint(uint16_t addr);
+        void removeBreakpoint(uint16_t addr);
+
+        void addWatchpoint(uint16_t addr, uint8_t flags);
+        void removeWatchpoint(uint16_t addr);
+
+        // Reads and runs commands until one resumes execution.
+        void prompt();
+
+        void onInstruction(const yb::CPU& cpu, const yb::Step& step) override;
+        void onFrame() override;
+        void onExec(uint16_t pc) override;
+        void onBreak() override;
+        void onWatch(uint16_t addr, uint8_t value, bool write) override;
+
+    private:
+        Debugger(const Debugger&) = delete;
+        Debugger& operator=(const Debugger&) = delete;
+
+        // Returns true if the command resumes execution.
+        bool execute(const std::string& line);
+
+        void printRegisters() const;
+        void printMemory(uint16_t addr, int count) const;
+        void printDisassembly(uint16_t addr, int count) const;
+        void printPoints() const;
+
+        void updateHook();
+
+        yb::Emulator* emulator_;
+
+        yb::BreakpointSet breakpoints_;
+
+        std::map<uint16_t, uint8_t> watchpoints_;
+        bool watchHit_;
+        std::string watchMessage_;
+
+        // Machine cycle of the last stop, so that resuming from a breakpoint
+        // doesn't stop at it again.
+        uint64_t stopCycle_;
+
+        int stepsLeft_;
+        bool hooked_;
+        bool quit_;
+
+        std::string lastCommand_;
+    };
+
+}
@@ -0,0 +1,57 @@
+#include "disasm.h"
+
+#include <cstdio>
+
+#include "ops.h"
+
+namespace yb {
+
+static void replace(std::string& text, const char* placeholder, const char* value)
+{
+    const size_t at = text.find(placeholder);
+    if (at != std::string::npos) {
+        text.replace(at, std::string(placeholder).size(), value);
+    }
+}
+
+static bool is_relative_jump(uint8_t op)
+{
+    return op == 0x18 || op == 0x20 || op == 0x28 || op == 0x30 || op == 0x38;
+}
+
+} // end namespace
+
+uint8_t yb::disassemble(uint16_t addr, const uint8_t bytes[3], std::string& text)
+{
+    char value[16];
+
+    const bool prefixed = bytes[0] == 0xCB;
+    const auto& table = prefixed ? yb::PREFIXED_INSTRUCTIONS : yb::INSTRUCTIONS;
+    const auto it = table.find(prefixed ? bytes[1] : bytes[0]);
+    if (it == table.end()) {
+        std::snprintf(value, sizeof(value), "DB $%02X", bytes[0]);
+        text = value;
+        return 1;
+    }
+
+    const yb::Instruction& inst = it->second;
+    text = inst.mnemonic;
+    while (!text.empty() && text.back() == ' ') {
+        text.pop_back();
+    }
+
+    if (is_relative_jump(bytes[0])) {
+        std::snprintf(value, sizeof(value), "$%04X", (uint16_t)(addr + inst.length + (int8_t) bytes[1]));
+    } else {
+        std::snprintf(value, sizeof(value), "%d", (int8_t) bytes[1]);
+    }
+    replace(text, "SBYTE", value);
+
+    std::snprintf(value, sizeof(value), "$%04X", bytes[2] << 8 | bytes[1]);
+    replace(text, "WORD", value);
+
+    std::snprintf(value, sizeof(value), "$%02X", bytes[1]);
+    replace(text, "BYTE", value);
+
+    return inst.length;
+}
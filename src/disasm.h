@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace yb {
+
+    // Renders the instruction whose bytes start at bytes[0] (three bytes are
+    // always read) using the INSTRUCTIONS mnemonics, with the BYTE, SBYTE and
+    // WORD placeholders replaced by the operands. Relative jumps show their
+    // target, computed from addr.
+    // Returns the instruction's length; unknown opcodes render as DB and count 1.
+    uint8_t disassemble(uint16_t addr, const uint8_t bytes[3], std::string& text);
+
+}
@@ -1,24 +1,451 @@
 #include "emulator.h"
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 
-yb::Emulator::Emulator(yb::Cartridge cartridge)
+#include "common.h"
+#include "hash.h"
+
+static constexpr char STATE_MAGIC[4] = { 'Y', 'B', 'S', 'T' };
+static constexpr uint32_t STATE_VERSION = 2;
+
+namespace yb {
+
+// Somewhere to read a state into without touching a running machine.
+struct StateScratch
+{
+    explicit StateScratch(const yb::Cartridge& cartridge)
+        : mmu(cartridge.data(), cartridge.isCGB())
+        , cpu(&mmu)
+        , ppu(&mmu)
+    {}
+
+    yb::MMU mmu;
+    yb::CPU cpu;
+    yb::PPU ppu;
+};
+
+static bool read_state_header(yb::StateReader& reader)
+{
+    char magic[sizeof(STATE_MAGIC)];
+    reader.readBytes(magic, sizeof(magic));
+
+    return std::memcmp(magic, STATE_MAGIC, sizeof(magic)) == 0 && reader.read32() == STATE_VERSION;
+}
+
+} // end namespace
+
+yb::Emulator::Emulator(yb::Cartridge cartridge, bool headless)
     : cartridge_(std::move(cartridge))
-    , mmu_(cartridge_.data())
+    , mmu_(cartridge_.data(), cartridge_.isCGB())
     , cpu_(&mmu_)
-    , window_("yoboy", 160, 144)
-{}
-        
+    , ppu_(&mmu_)
+#ifndef YB_NO_WINDOW
+    , window_(headless ? nullptr : new yb::Window("yoboy", YB_SCREEN_WIDTH, YB_SCREEN_HEIGHT))
+#endif
+    , hooksRemoved_(false)
+    , stopped_(false)
+    , cycles_(0)
+    , runAhead_(0)
+{
+#ifdef YB_NO_WINDOW
+    YB_UNUSED(headless);
+#endif
+    mmu_.setClock(&cycles_);
+    std::memset(execPages_, 0, sizeof(execPages_));
+}
+
 bool yb::Emulator::isRunning() const
 {
-    return !window_.isQuit();
+#ifndef YB_NO_WINDOW
+    if (window_ && window_->isQuit()) {
+        return false;
+    }
+#endif
+    return !stopped_;
 }
 
+#ifndef YB_NO_WINDOW
 void yb::Emulator::start()
 {
+    if (!window_) {
+        yb::error("A headless emulator has no window to run in.\n");
+        return;
+    }
+
     std::puts("Emulation started.");
-    while (isRunning()) {
-        cpu_.tick();
-        window_.update();
-        window_.draw();
+    while (isRunning() && !cpu_.isLocked()) {
+        window_->update();
+        setInput(window_->buttons());
+        runFrame();
+
+        if (runAhead_ > 0) {
+            presentRunAhead();
+        } else {
+            window_->draw(ppu_.framebuffer(), ppu_.dirtyLines());
+            ppu_.clearDirtyLines();
+        }
+    }
+}
+#endif
+
+void yb::Emulator::runFrame()
+{
+    bool frameDone = false;
+    while (!frameDone) {
+        if (execPages_[cpu_.PC.value >> YB_PAGE_SHIFT] != 0) {
+            runExecHooks();
+        }
+
+        // a breakpoint's prompt may install hooks, e.g. to single step
+        if (!hooks_.empty()) {
+            frameDone = runInstrumented();
+            continue;
+        }
+
+        const uint8_t cycles = cpu_.tick();
+        frameDone = ppu_.step(cycles >> mmu_.speedShift());
+        cycles_ += cycles;
+
+        if (!breaks_.empty()) {
+            runBreaks();
+        }
+    }
+
+    for (yb::FrameHook* hook : frameHooks_) {
+        hook->onFrame();
+    }
+}
+
+// Runs the frame, or as much of it as hooks stay installed for, starting
+// with an instruction whose exec hooks already ran.
+// Returns true if the frame was completed.
+bool yb::Emulator::runInstrumented()
+{
+    for (;;) {
+        yb::Step step;
+        const bool frameDone = this->step(step);
+
+        // hooks added by a hook only see the next instruction
+        const size_t count = hooks_.size();
+        for (size_t i = 0; i < count; ++i) {
+            if (hooks_[i]) {
+                hooks_[i]->onInstruction(cpu_, step);
+            }
+        }
+
+        if (hooksRemoved_) {
+            hooks_.erase(std::remove(hooks_.begin(), hooks_.end(), nullptr), hooks_.end());
+            hooksRemoved_ = false;
+        }
+
+        if (!breaks_.empty()) {
+            runBreaks();
+        }
+
+        if (frameDone || hooks_.empty()) {
+            return frameDone;
+        }
+
+        if (execPages_[cpu_.PC.value >> YB_PAGE_SHIFT] != 0) {
+            runExecHooks();
+        }
+    }
+}
+
+void yb::Emulator::runExecHooks()
+{
+    const uint16_t pc = cpu_.PC.value;
+    // indexed, since a hook's prompt may change the hooks
+    for (size_t i = 0; i < execHooks_.size(); ++i) {
+        execHooks_[i]->onExec(pc);
+    }
+}
+
+void yb::Emulator::runBreaks()
+{
+    // swapped out so that breaks requested from onBreak() wait for the next instruction
+    std::vector<yb::BreakHook*> breaks;
+    breaks.swap(breaks_);
+    for (yb::BreakHook* hook : breaks) {
+        hook->onBreak();
     }
 }
+
+bool yb::Emulator::step(yb::Step& step)
+{
+    // peeked so that describing the instruction can't trip read watchpoints
+    step.pc = cpu_.PC.value;
+    step.bank = mmu_.bankAt(step.pc);
+    step.op = mmu_.peek8(step.pc);
+    step.operands[0] = mmu_.peek8(step.pc + 1);
+    step.operands[1] = mmu_.peek8(step.pc + 2);
+
+    step.cycles = cpu_.tick();
+    const bool frameDone = ppu_.step(step.cycles >> mmu_.speedShift());
+    cycles_ += step.cycles;
+    step.cycle = cycles_;
+
+    return frameDone;
+}
+
+void yb::Emulator::addHook(yb::InstructionHook* hook)
+{
+    hooks_.push_back(hook);
+}
+
+void yb::Emulator::removeHook(yb::InstructionHook* hook)
+{
+    // cleared rather than erased: the instrumented loop may be iterating the hooks
+    std::replace(hooks_.begin(), hooks_.end(), hook, (yb::InstructionHook*) nullptr);
+    hooksRemoved_ = true;
+}
+
+void yb::Emulator::addFrameHook(yb::FrameHook* hook)
+{
+    frameHooks_.push_back(hook);
+}
+
+void yb::Emulator::removeFrameHook(yb::FrameHook* hook)
+{
+    frameHooks_.erase(std::remove(frameHooks_.begin(), frameHooks_.end(), hook), frameHooks_.end());
+}
+
+void yb::Emulator::addExecHook(yb::ExecHook* hook)
+{
+    execHooks_.push_back(hook);
+}
+
+void yb::Emulator::removeExecHook(yb::ExecHook* hook)
+{
+    execHooks_.erase(std::remove(execHooks_.begin(), execHooks_.end(), hook), execHooks_.end());
+}
+
+void yb::Emulator::watchExec(uint16_t addr)
+{
+    ++execPages_[addr >> YB_PAGE_SHIFT];
+}
+
+void yb::Emulator::unwatchExec(uint16_t addr)
+{
+    --execPages_[addr >> YB_PAGE_SHIFT];
+}
+
+void yb::Emulator::requestBreak(yb::BreakHook* hook)
+{
+    if (std::find(breaks_.begin(), breaks_.end(), hook) == breaks_.end()) {
+        breaks_.push_back(hook);
+    }
+}
+
+void yb::Emulator::cancelBreak(yb::BreakHook* hook)
+{
+    breaks_.erase(std::remove(breaks_.begin(), breaks_.end(), hook), breaks_.end());
+}
+
+void yb::Emulator::stop()
+{
+    stopped_ = true;
+}
+
+void yb::Emulator::setInput(uint8_t buttons)
+{
+    mmu_.setJoypad(buttons);
+}
+
+uint8_t yb::Emulator::input() const
+{
+    return mmu_.joypad();
+}
+
+void yb::Emulator::setRunAhead(int frames)
+{
+    runAhead_ = frames;
+}
+
+void yb::Emulator::setFilter(yb::Filter filter, int factor)
+{
+#ifndef YB_NO_WINDOW
+    if (window_) {
+        window_->setFilter(filter, factor);
+    }
+#else
+    YB_UNUSED(filter);
+    YB_UNUSED(factor);
+#endif
+}
+
+void yb::Emulator::setPPUEngine(yb::PPUEngine engine)
+{
+    ppu_.setEngine(engine);
+}
+
+#ifndef YB_NO_WINDOW
+// Run-ahead hides the game's own input lag: the frames after the real one are
+// emulated speculatively, the last of them is shown, and the machine is rolled back.
+void yb::Emulator::presentRunAhead()
+{
+    saveState(runAheadState_);
+
+    // hooks only get to see the timeline that is kept
+    std::vector<yb::InstructionHook*> hooks;
+    std::vector<yb::FrameHook*> frameHooks;
+    std::vector<yb::ExecHook*> execHooks;
+    hooks.swap(hooks_);
+    frameHooks.swap(frameHooks_);
+    execHooks.swap(execHooks_);
+
+    // Cartridge RAM may be the .sav file itself, which must never hold a
+    // future that gets rolled back, so speculation writes to a copy.
+    uint8_t* const cartRam = mmu_.cartridgeRam();
+    const size_t cartRamSize = mmu_.cartridgeRamSize();
+    if (cartRam) {
+        runAheadRam_.assign(cartRam, cartRam + cartRamSize);
+        mmu_.setCartridgeRam(runAheadRam_.data(), cartRamSize);
+    }
+
+    const bool logging = yb::log_enabled();
+    yb::log_enabled() = false;
+    for (int i = 0; i < runAhead_; ++i) {
+        runFrame();
+    }
+    yb::log_enabled() = logging;
+
+    hooks_.swap(hooks);
+    frameHooks_.swap(frameHooks);
+    execHooks_.swap(execHooks);
+    if (cartRam) {
+        mmu_.setCartridgeRam(cartRam, cartRamSize);
+    }
+
+    // the framebuffer isn't part of the state, so the dirty lines stay
+    // relative to the speculative frame that is on screen
+    window_->draw(ppu_.framebuffer(), ppu_.dirtyLines());
+    ppu_.clearDirtyLines();
+
+    applyState(runAheadState_.data(), runAheadState_.size());
+}
+#endif
+
+void yb::Emulator::saveState(std::vector<uint8_t>& out) const
+{
+    out.clear();
+
+    yb::StateWriter writer(out);
+    writer.writeBytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+    writer.write32(STATE_VERSION);
+    writer.write64(cycles_);
+
+    cpu_.save(writer);
+    mmu_.save(writer);
+    ppu_.save(writer);
+}
+
+// The whole state is first read into a throwaway machine, so that a truncated
+// one is turned down before anything of this one has been overwritten.
+bool yb::Emulator::loadState(const uint8_t* data, size_t size)
+{
+    {
+        yb::StateReader reader(data, size);
+        if (!yb::read_state_header(reader)) {
+            yb::error("Invalid or incompatible save state.\n");
+            return false;
+        }
+
+        std::unique_ptr<yb::StateScratch> scratch(new yb::StateScratch(cartridge_));
+        reader.read64();
+        scratch->cpu.load(reader);
+        scratch->mmu.load(reader);
+        scratch->ppu.load(reader);
+        if (!reader.ok()) {
+            yb::error("Truncated save state.\n");
+            return false;
+        }
+    }
+
+    applyState(data, size);
+    return true;
+}
+
+// For states known to be complete, like the ones run-ahead saves itself.
+void yb::Emulator::applyState(const uint8_t* data, size_t size)
+{
+    yb::StateReader reader(data, size);
+    yb::read_state_header(reader);
+
+    cycles_ = reader.read64();
+
+    cpu_.load(reader);
+    mmu_.load(reader);
+    ppu_.load(reader);
+}
+
+std::unique_ptr<yb::Emulator> yb::Emulator::fork()
+{
+    std::unique_ptr<yb::Emulator> child(new yb::Emulator(cartridge_, true));
+    child->cycles_ = cycles_;
+    child->mmu_.forkFrom(mmu_);
+    child->ppu_.setEngine(ppu_.engine());
+
+    // what's left is a few registers, passed on the way states are
+    std::vector<uint8_t> state;
+    yb::StateWriter writer(state);
+    cpu_.save(writer);
+    ppu_.save(writer);
+
+    yb::StateReader reader(state.data(), state.size());
+    child->cpu_.load(reader);
+    child->ppu_.load(reader);
+
+    return child;
+}
+
+const uint32_t* yb::Emulator::framebuffer() const
+{
+    return ppu_.framebuffer();
+}
+
+uint64_t yb::Emulator::frameHash() const
+{
+    return yb::hash64(ppu_.framebuffer(), YB_SCREEN_WIDTH * YB_SCREEN_HEIGHT * sizeof(uint32_t));
+}
+
+uint64_t yb::Emulator::cycles() const
+{
+    return cycles_;
+}
+
+bool yb::Emulator::isLocked() const
+{
+    return cpu_.isLocked();
+}
+
+const yb::Cartridge& yb::Emulator::cartridge() const
+{
+    return cartridge_;
+}
+
+const yb::CPU& yb::Emulator::cpu() const
+{
+    return cpu_;
+}
+
+yb::CPU& yb::Emulator::cpu()
+{
+    return cpu_;
+}
+
+const yb::MMU& yb::Emulator::mmu() const
+{
+    return mmu_;
+}
+
+yb::MMU& yb::Emulator::mmu()
+{
+    return mmu_;
+}
+
+const std::string& yb::Emulator::serial() const
+{
+    return mmu_.serial();
+}
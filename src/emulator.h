@@ -1,8 +1,15 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "cartridge.h"
 #include "cpu.h"
+#include "hook.h"
 #include "mmu.h"
+#include "ppu.h"
 #include "window.h"
 
 namespace yb {
@@ -10,16 +17,128 @@ namespace yb {
     class Emulator
     {
     public:
-        Emulator(yb::Cartridge cartridge);
+        // A headless emulator has no window: frames are only produced through runFrame().
+        // Builds without a window (YB_NO_WINDOW, like libyoboy) are always headless.
+        Emulator(yb::Cartridge cartridge, bool headless = false);
         
         bool isRunning() const;
 
+#ifndef YB_NO_WINDOW
+        // Runs until the window is closed or the CPU locks up. Headless
+        // emulators have no window and return at once.
         void start();
+#endif
+
+        // Emulates until the PPU completes the next frame.
+        void runFrame();
+
+        // Executes a single instruction, bypassing hooks, and describes it in step.
+        // Returns true if the instruction completed a frame; frame hooks are not run.
+        bool step(yb::Step& step);
+
+        // Hooks are not owned and must outlive the emulator or be removed.
+        // They may remove themselves from within their callbacks.
+        void addHook(yb::InstructionHook* hook);
+        void removeHook(yb::InstructionHook* hook);
+
+        void addFrameHook(yb::FrameHook* hook);
+        void removeFrameHook(yb::FrameHook* hook);
+
+        // Exec hooks run before any instruction starting on a page holding a
+        // watched address. Watches are counted, so that several breakpoints
+        // and clients can share a page. The frame loop only tests PC's page,
+        // so breakpoints cost nothing elsewhere and never need an instruction hook.
+        void addExecHook(yb::ExecHook* hook);
+        void removeExecHook(yb::ExecHook* hook);
+        void watchExec(uint16_t addr);
+        void unwatchExec(uint16_t addr);
+
+        // Calls hook once the current instruction has completed, after any
+        // instruction hooks saw it. Requests are dropped once served.
+        void requestBreak(yb::BreakHook* hook);
+        void cancelBreak(yb::BreakHook* hook);
+
+        // Makes isRunning() false, ending start().
+        void stop();
+
+        // Sets the held joypad buttons (see yb::Button). The window's keyboard
+        // state replaces them before every frame start() runs.
+        void setInput(uint8_t buttons);
+        uint8_t input() const;
+
+        // Number of frames emulated ahead of the presented one (0 disables run-ahead).
+        void setRunAhead(int frames);
+
+        // Upscaling filter of the window; ignored when headless.
+        void setFilter(yb::Filter filter, int factor);
+
+        // Renderer the PPU draws lines with (AUTO by default).
+        void setPPUEngine(yb::PPUEngine engine);
+
+        void saveState(std::vector<uint8_t>& out) const;
+        // Leaves the machine untouched and returns false if the state is
+        // invalid, incompatible or truncated.
+        bool loadState(const uint8_t* data, size_t size);
+
+        // A headless copy of this machine that shares its memory copy-on-write,
+        // for trying several inputs from one point without saving and loading
+        // full states. The fork starts without hooks or run-ahead and, as after
+        // loading a state, its framebuffer is only complete again after a frame.
+        // Neither machine may be running on another thread meanwhile.
+        std::unique_ptr<yb::Emulator> fork();
+
+        const uint32_t* framebuffer() const;
+
+        uint64_t frameHash() const;
+
+        uint64_t cycles() const;
+
+        // True once the CPU hung on an instruction it cannot execute.
+        bool isLocked() const;
+
+        const yb::Cartridge& cartridge() const;
+        const yb::CPU& cpu() const;
+        yb::CPU& cpu();
+        const yb::MMU& mmu() const;
+        yb::MMU& mmu();
+
+        // Everything the game sent over the serial port.
+        const std::string& serial() const;
 
     private:
+        Emulator(const Emulator&) = delete;
+        Emulator& operator=(const Emulator&) = delete;
+
+        bool runInstrumented();
+        void runExecHooks();
+        void runBreaks();
+        void applyState(const uint8_t* data, size_t size);
+
+#ifndef YB_NO_WINDOW
+        void presentRunAhead();
+#endif
+
         yb::Cartridge cartridge_;
         yb::MMU mmu_;
         yb::CPU cpu_;
-        yb::Window window_;
+        yb::PPU ppu_;
+#ifndef YB_NO_WINDOW
+        std::unique_ptr<yb::Window> window_;
+#endif
+
+        std::vector<yb::InstructionHook*> hooks_;
+        bool hooksRemoved_;
+        std::vector<yb::FrameHook*> frameHooks_;
+        std::vector<yb::BreakHook*> breaks_;
+        std::vector<yb::ExecHook*> execHooks_;
+        uint16_t execPages_[YB_PAGE_COUNT];
+
+        bool stopped_;
+
+        uint64_t cycles_;
+
+        int runAhead_;
+        std::vector<uint8_t> runAheadState_;
+        std::vector<uint8_t> runAheadRam_;
     };
 }
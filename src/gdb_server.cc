@@ -0,0 +1,724 @@
+#include "gdb_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common.h"
+
+namespace yb {
+
+// Largest packet accepted or sent, advertised to the client with qSupported.
+static constexpr size_t PACKET_SIZE = 0x1000;
+
+static constexpr int REGISTER_COUNT = 6;
+// Registers GDB's z80 layout has beyond ours: IX, IY, the shadow set and IR.
+static constexpr int Z80_REGISTER_COUNT = 13;
+
+static const char HEX[] = "0123456789abcdef";
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Parses hex digits from text at pos, leaving pos after the last one.
+static bool parse_hex(const std::string& text, size_t& pos, uint32_t& value)
+{
+    const size_t start = pos;
+    value = 0;
+    while (pos < text.size() && hex_digit(text[pos]) >= 0 && pos - start < 8) {
+        value = (value << 4) | hex_digit(text[pos]);
+        ++pos;
+    }
+
+    return pos != start;
+}
+
+static bool expect(const std::string& text, size_t& pos, char c)
+{
+    if (pos < text.size() && text[pos] == c) {
+        ++pos;
+        return true;
+    }
+    return false;
+}
+
+// Register values go over the wire in target (little endian) byte order.
+static void append_u16(std::string& out, uint16_t value)
+{
+    out += HEX[(value >> 4) & 0xF];
+    out += HEX[value & 0xF];
+    out += HEX[(value >> 12) & 0xF];
+    out += HEX[(value >> 8) & 0xF];
+}
+
+static bool parse_u16(const std::string& text, size_t pos, uint16_t& value)
+{
+    if (pos + 4 > text.size()) {
+        return false;
+    }
+
+    int digits[4];
+    for (int i = 0; i < 4; ++i) {
+        digits[i] = hex_digit(text[pos + i]);
+        if (digits[i] < 0) {
+            return false;
+        }
+    }
+
+    value = (uint16_t)(digits[0] << 4 | digits[1] | digits[2] << 12 | digits[3] << 8);
+    return true;
+}
+
+// Removes the socket file at path, if there is one. Returns false, leaving it
+// alone, if anything else is there.
+static bool unlink_socket(const std::string& path)
+{
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        return false;
+    }
+
+    return ::unlink(path.c_str()) == 0;
+}
+
+static yb::Register* register_at(yb::CPU& cpu, uint32_t index)
+{
+    yb::Register* registers[REGISTER_COUNT] = { &cpu.AF, &cpu.BC, &cpu.DE, &cpu.HL, &cpu.SP, &cpu.PC };
+    return index < REGISTER_COUNT ? registers[index] : nullptr;
+}
+
+} // end namespace
+
+yb::GdbServer::GdbServer(yb::Emulator* emulator)
+    : emulator_(emulator)
+    , listener_(-1)
+    , client_(-1)
+    , inboxPos_(0)
+    , stopCycle_(0)
+    , stepping_(false)
+    , hooked_(false)
+    , lockReported_(false)
+{
+    emulator_->addFrameHook(this);
+    emulator_->addExecHook(this);
+    emulator_->mmu().setWatchListener(this);
+}
+
+yb::GdbServer::~GdbServer()
+{
+    if (client_ >= 0) {
+        // tell the client the program is gone
+        sendPacket("W00");
+        detach();
+    }
+
+    if (listener_ >= 0) {
+        ::close(listener_);
+        if (!unixPath_.empty()) {
+            yb::unlink_socket(unixPath_);
+        }
+    }
+
+    emulator_->mmu().setWatchListener(nullptr);
+    emulator_->removeExecHook(this);
+    emulator_->removeFrameHook(this);
+    emulator_->cancelBreak(this);
+}
+
+bool yb::GdbServer::listen(const std::string& address)
+{
+    if (address.compare(0, 5, "unix:") == 0) {
+        return listenUnix(address.substr(5));
+    }
+    if (address.find('/') != std::string::npos) {
+        return listenUnix(address);
+    }
+
+    // PORT, :PORT or HOST:PORT, like GDB's own target remote
+    const size_t colon = address.rfind(':');
+    const std::string host = colon == std::string::npos ? "" : address.substr(0, colon);
+    const std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+
+    const long number = port.find_first_not_of("0123456789") == std::string::npos ? std::strtol(port.c_str(), nullptr, 10) : 0;
+    if (port.empty() || number <= 0 || number > 0xFFFF) {
+        yb::error("Invalid GDB port in %s.\n", address.c_str());
+        return false;
+    }
+
+    return listenTcp(host, (uint16_t) number);
+}
+
+bool yb::GdbServer::listenTcp(const std::string& host, uint16_t port)
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (host.empty() || host == "localhost") {
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        yb::error("Invalid GDB host %s; use localhost or an IPv4 address.\n", host.c_str());
+        return false;
+    }
+
+    listener_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listener_ < 0) {
+        yb::error("Could not create the GDB socket: %s.\n", std::strerror(errno));
+        return false;
+    }
+
+    const int reuse = 1;
+    ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    char name[INET_ADDRSTRLEN];
+    ::inet_ntop(AF_INET, &addr.sin_addr, name, sizeof(name));
+
+    if (::bind(listener_, (const sockaddr*) &addr, sizeof(addr)) != 0) {
+        yb::error("Could not bind %s:%u: %s.\n", name, port, std::strerror(errno));
+        ::close(listener_);
+        listener_ = -1;
+        return false;
+    }
+
+    if (!startListening()) {
+        return false;
+    }
+
+    std::printf("Waiting for GDB on %s:%u.\n", name, port);
+    return true;
+}
+
+bool yb::GdbServer::listenUnix(const std::string& path)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        yb::error("Invalid GDB socket path %s.\n", path.c_str());
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    // a stale socket file from an earlier run would make bind fail
+    if (!yb::unlink_socket(path)) {
+        yb::error("%s exists and is not a socket; not replacing it.\n", path.c_str());
+        return false;
+    }
+
+    listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener_ < 0) {
+        yb::error("Could not create the GDB socket: %s.\n", std::strerror(errno));
+        return false;
+    }
+
+    if (::bind(listener_, (const sockaddr*) &addr, sizeof(addr)) != 0) {
+        yb::error("Could not bind %s: %s.\n", path.c_str(), std::strerror(errno));
+        ::close(listener_);
+        listener_ = -1;
+        return false;
+    }
+    unixPath_ = path;
+
+    if (!startListening()) {
+        return false;
+    }
+
+    std::printf("Waiting for GDB on %s.\n", path.c_str());
+    return true;
+}
+
+bool yb::GdbServer::startListening()
+{
+    if (::listen(listener_, 1) != 0) {
+        yb::error("Could not listen for GDB: %s.\n", std::strerror(errno));
+        ::close(listener_);
+        listener_ = -1;
+        if (!unixPath_.empty()) {
+            yb::unlink_socket(unixPath_);
+            unixPath_.clear();
+        }
+        return false;
+    }
+
+    // polled once per frame, so accepting must never block
+    ::fcntl(listener_, F_SETFL, ::fcntl(listener_, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void yb::GdbServer::onInstruction(const yb::CPU& cpu, const yb::Step& step)
+{
+    YB_UNUSED(cpu);
+    YB_UNUSED(step);
+
+    if (client_ < 0) {
+        return;
+    }
+
+    if (!watchReply_.empty()) {
+        std::string reply;
+        reply.swap(watchReply_);
+        serve(reply);
+    }
+    else if (stepping_) {
+        serve("S05");
+    }
+}
+
+void yb::GdbServer::onExec(uint16_t pc)
+{
+    // a step or watchpoint may have stopped here already
+    if (client_ >= 0 && breakpoints_.contains(pc) && emulator_->cycles() != stopCycle_) {
+        serve("S05");
+    }
+}
+
+void yb::GdbServer::onFrame()
+{
+    if (client_ < 0) {
+        client_ = ::accept(listener_, nullptr, nullptr);
+        if (client_ < 0) {
+            return;
+        }
+
+        const int nodelay = 1;
+        ::setsockopt(client_, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        ::fcntl(client_, F_SETFL, ::fcntl(client_, F_GETFL) & ~O_NONBLOCK);
+
+        // the client starts by asking why we stopped
+        serve("");
+        return;
+    }
+
+    if (emulator_->isLocked() && !lockReported_) {
+        lockReported_ = true;
+        serve("S04");
+        return;
+    }
+
+    // look for a Ctrl-C without blocking
+    char buffer[256];
+    const ssize_t n = ::recv(client_, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        detach();
+        return;
+    }
+
+    if (n > 0) {
+        inbox_.append(buffer, n);
+        if (inbox_.find('\x03', inboxPos_) != std::string::npos) {
+            inbox_.clear();
+            inboxPos_ = 0;
+            serve("S02");
+        }
+    }
+}
+
+void yb::GdbServer::onBreak()
+{
+    // the instruction hook may have served the watchpoint already
+    if (client_ >= 0 && !watchReply_.empty()) {
+        std::string reply;
+        reply.swap(watchReply_);
+        serve(reply);
+    }
+}
+
+void yb::GdbServer::onWatch(uint16_t addr, uint8_t value, bool write)
+{
+    YB_UNUSED(value);
+
+    const auto watchpoint = watchpoints_.find(addr);
+    if (watchpoint == watchpoints_.end()) {
+        return;
+    }
+
+    const char* kind = watchpoint->second == (WATCH_READ | WATCH_WRITE) ? "awatch" : write ? "watch" : "rwatch";
+
+    char reply[32];
+    std::snprintf(reply, sizeof(reply), "T05%s:%04x;", kind, addr);
+    watchReply_ = reply;
+    emulator_->requestBreak(this);
+}
+
+void yb::GdbServer::serve(const std::string& stopReply)
+{
+    stopCycle_ = emulator_->cycles();
+    stepping_ = false;
+
+    if (!stopReply.empty() && !sendPacket(stopReply)) {
+        detach();
+        return;
+    }
+
+    std::string packet;
+    std::string reply;
+    while (readPacket(packet)) {
+        reply.clear();
+        const bool resume = handle(packet, reply);
+
+        if (client_ < 0) {
+            // killed or detached
+            return;
+        }
+        if (resume) {
+            updateHook();
+            return;
+        }
+        if (!sendPacket(reply)) {
+            break;
+        }
+    }
+
+    detach();
+}
+
+bool yb::GdbServer::handle(const std::string& packet, std::string& reply)
+{
+    yb::CPU& cpu = emulator_->cpu();
+    size_t pos = 1;
+    uint32_t addr = 0;
+    uint32_t length = 0;
+
+    switch (packet.empty() ? '\0' : packet[0]) {
+    case '?':
+        reply = emulator_->isLocked() ? "S04" : "S05";
+        break;
+    case 'g':
+        reply = readRegisters();
+        break;
+    case 'G':
+        writeRegisters(packet.substr(1));
+        reply = "OK";
+        break;
+    case 'p':
+        if (!parse_hex(packet, pos, addr)) {
+            reply = "E01";
+        } else if (register_at(cpu, addr)) {
+            append_u16(reply, register_at(cpu, addr)->value);
+        } else {
+            reply = addr < Z80_REGISTER_COUNT ? "xxxx" : "E01";
+        }
+        break;
+    case 'P': {
+        uint16_t value = 0;
+        yb::Register* reg = nullptr;
+        if (parse_hex(packet, pos, addr) && expect(packet, pos, '=') && parse_u16(packet, pos, value)) {
+            reg = register_at(cpu, addr);
+        }
+        if (reg) {
+            reg->value = value;
+            reply = "OK";
+        } else {
+            reply = "E01";
+        }
+        break;
+    }
+    case 'm':
+        if (parse_hex(packet, pos, addr) && expect(packet, pos, ',') && parse_hex(packet, pos, length)) {
+            // served with one copy per contiguous run, not a read per byte
+            // leave room for the framing around the hex digits
+            length = std::min<uint32_t>(length, (PACKET_SIZE - 4) / 2);
+
+            uint8_t data[PACKET_SIZE / 2];
+            emulator_->mmu().peek((uint16_t) addr, data, length);
+
+            reply.reserve(length * 2);
+            for (uint32_t i = 0; i < length; ++i) {
+                reply += HEX[data[i] >> 4];
+                reply += HEX[data[i] & 0xF];
+            }
+        } else {
+            reply = "E01";
+        }
+        break;
+    case 'M':
+        if (parse_hex(packet, pos, addr) && expect(packet, pos, ',') && parse_hex(packet, pos, length) &&
+            expect(packet, pos, ':') && packet.size() - pos >= length * 2) {
+            for (uint32_t i = 0; i < length; ++i) {
+                const int hi = hex_digit(packet[pos + i * 2]);
+                const int lo = hex_digit(packet[pos + i * 2 + 1]);
+                if (hi < 0 || lo < 0) {
+                    reply = "E01";
+                    return false;
+                }
+                emulator_->mmu().poke8((uint16_t)(addr + i), (uint8_t)(hi << 4 | lo));
+            }
+            reply = "OK";
+        } else {
+            reply = "E01";
+        }
+        break;
+    case 'c':
+    case 's':
+        if (parse_hex(packet, pos, addr)) {
+            cpu.PC.value = (uint16_t) addr;
+        }
+        stepping_ = packet[0] == 's';
+        return true;
+    case 'Z':
+    case 'z':
+        pos = 2;
+        if (packet.size() > 2 && expect(packet, pos, ',') && parse_hex(packet, pos, addr) &&
+            expect(packet, pos, ',') && parse_hex(packet, pos, length)) {
+            reply = setPoint(packet[1], (uint16_t) addr, (uint16_t) length, packet[0] == 'Z') ? "OK" : "";
+        } else {
+            reply = "E01";
+        }
+        break;
+    case 'k':
+        emulator_->stop();
+        detach();
+        return true;
+    case 'D':
+        sendPacket("OK");
+        detach();
+        return true;
+    case 'H':
+        // a single thread: any thread selection is fine
+        reply = "OK";
+        break;
+    case 'q':
+        if (packet.compare(0, 10, "qSupported") == 0) {
+            char supported[32];
+            std::snprintf(supported, sizeof(supported), "PacketSize=%zx", PACKET_SIZE);
+            reply = supported;
+        } else if (packet == "qAttached") {
+            reply = "1";
+        }
+        break;
+    default:
+        // an empty reply tells the client the packet is unsupported
+        break;
+    }
+
+    return false;
+}
+
+bool yb::GdbServer::readPacket(std::string& packet)
+{
+    char c = 0;
+    for (;;) {
+        // skip acks, interrupts sent while already stopped and line noise
+        do {
+            if (!readByte(c)) {
+                return false;
+            }
+        } while (c != '$');
+
+        packet.clear();
+        uint8_t sum = 0;
+        while (readByte(c) && c != '#') {
+            if (packet.size() < PACKET_SIZE) {
+                packet += c;
+            }
+            sum += (uint8_t) c;
+        }
+
+        char checksum[2];
+        if (c != '#' || !readByte(checksum[0]) || !readByte(checksum[1])) {
+            return false;
+        }
+
+        const int hi = hex_digit(checksum[0]);
+        const int lo = hex_digit(checksum[1]);
+        if (hi >= 0 && lo >= 0 && (uint8_t)(hi << 4 | lo) == sum) {
+            return sendAll("+", 1);
+        }
+
+        // ask for a retransmission
+        if (!sendAll("-", 1)) {
+            return false;
+        }
+    }
+}
+
+bool yb::GdbServer::readByte(char& c)
+{
+    if (inboxPos_ == inbox_.size()) {
+        inbox_.clear();
+        inboxPos_ = 0;
+
+        char buffer[PACKET_SIZE];
+        const ssize_t n = ::recv(client_, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            return false;
+        }
+        inbox_.assign(buffer, n);
+    }
+
+    c = inbox_[inboxPos_++];
+    return true;
+}
+
+bool yb::GdbServer::sendPacket(const std::string& data)
+{
+    uint8_t sum = 0;
+    for (char c : data) {
+        sum += (uint8_t) c;
+    }
+
+    std::string framed;
+    framed.reserve(data.size() + 4);
+    framed += '$';
+    framed += data;
+    framed += '#';
+    framed += HEX[sum >> 4];
+    framed += HEX[sum & 0xF];
+
+    return sendAll(framed.data(), framed.size());
+}
+
+bool yb::GdbServer::sendAll(const char* data, size_t length)
+{
+    while (length > 0) {
+        // a vanished client must not kill us with SIGPIPE
+        const ssize_t n = ::send(client_, data, length, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+std::string yb::GdbServer::readRegisters() const
+{
+    const yb::CPU& cpu = emulator_->cpu();
+
+    std::string hex;
+    append_u16(hex, cpu.AF.value);
+    append_u16(hex, cpu.BC.value);
+    append_u16(hex, cpu.DE.value);
+    append_u16(hex, cpu.HL.value);
+    append_u16(hex, cpu.SP.value);
+    append_u16(hex, cpu.PC.value);
+
+    return hex;
+}
+
+void yb::GdbServer::writeRegisters(const std::string& hex)
+{
+    yb::CPU& cpu = emulator_->cpu();
+
+    for (int i = 0; i < REGISTER_COUNT; ++i) {
+        uint16_t value = 0;
+        if (!parse_u16(hex, i * 4, value)) {
+            break;
+        }
+        register_at(cpu, i)->value = value;
+    }
+}
+
+bool yb::GdbServer::setPoint(char type, uint16_t addr, uint16_t length, bool insert)
+{
+    uint8_t flags = 0;
+    switch (type) {
+    case '0':
+    case '1':
+        // software and hardware breakpoints are the same thing here
+        if (insert) {
+            if (breakpoints_.add(addr)) {
+                emulator_->watchExec(addr);
+            }
+        } else if (breakpoints_.remove(addr)) {
+            emulator_->unwatchExec(addr);
+        }
+        return true;
+    case '2':
+        flags = WATCH_WRITE;
+        break;
+    case '3':
+        flags = WATCH_READ;
+        break;
+    case '4':
+        flags = WATCH_READ | WATCH_WRITE;
+        break;
+    default:
+        return false;
+    }
+
+    for (uint32_t i = 0; i < std::max<uint16_t>(length, 1); ++i) {
+        const uint16_t a = (uint16_t)(addr + i);
+        if (insert) {
+            watchpoints_[a] |= flags;
+            emulator_->mmu().watch(a, flags);
+        } else if (watchpoints_.count(a) != 0) {
+            watchpoints_[a] &= ~flags;
+            if (watchpoints_[a] == 0) {
+                watchpoints_.erase(a);
+            }
+            emulator_->mmu().unwatch(a, flags);
+        }
+    }
+
+    return true;
+}
+
+void yb::GdbServer::detach()
+{
+    if (client_ >= 0) {
+        ::close(client_);
+        client_ = -1;
+    }
+
+    inbox_.clear();
+    inboxPos_ = 0;
+
+    for (uint16_t addr : breakpoints_.addresses()) {
+        emulator_->unwatchExec(addr);
+    }
+    breakpoints_.clear();
+    for (const auto& watchpoint : watchpoints_) {
+        emulator_->mmu().unwatch(watchpoint.first, watchpoint.second);
+    }
+    watchpoints_.clear();
+    watchReply_.clear();
+    emulator_->cancelBreak(this);
+
+    stepping_ = false;
+    lockReported_ = false;
+    updateHook();
+}
+
+void yb::GdbServer::updateHook()
+{
+    const bool wanted = client_ >= 0 && stepping_;
+    if (wanted == hooked_) {
+        return;
+    }
+
+    if (wanted) {
+        emulator_->addHook(this);
+    } else {
+        emulator_->removeHook(this);
+    }
+    hooked_ = wanted;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "breakpoints.h"
+#include "emulator.h"
+#include "hook.h"
+#include "mmu.h"
+
+namespace yb {
+
+    // GDB remote serial protocol server.
+    //
+    // Registers are reported as AF, BC, DE, HL, SP and PC, 16 bits each, which
+    // is the head of GDB's z80 register layout. Breakpoints (Z0/Z1), watchpoints
+    // (Z2-Z4), single steps and bulk memory transfers are supported.
+    //
+    // The socket is only polled at frame boundaries, for a connection or for a
+    // Ctrl-C from an attached client, so an idle server costs nothing per
+    // instruction. Watchpoints stop through Emulator::requestBreak() and
+    // breakpoints through exec watches on their pages; the instruction hook is
+    // installed only while a step is pending.
+    class GdbServer : public yb::InstructionHook, public yb::FrameHook, public yb::ExecHook, public yb::BreakHook, public yb::WatchListener
+    {
+    public:
+        GdbServer(yb::Emulator* emulator);
+        ~GdbServer();
+
+        // Listens on a Unix socket if address is unix:PATH or contains a slash,
+        // otherwise on TCP at PORT, :PORT or HOST:PORT, with HOST defaulting to
+        // localhost. An existing file at the socket path is only replaced if it
+        // is a socket. Returns false on failure.
+        bool listen(const std::string& address);
+
+        void onInstruction(const yb::CPU& cpu, const yb::Step& step) override;
+        void onFrame() override;
+        void onExec(uint16_t pc) override;
+        void onBreak() override;
+        void onWatch(uint16_t addr, uint8_t value, bool write) override;
+
+    private:
+        GdbServer(const GdbServer&) = delete;
+        GdbServer& operator=(const GdbServer&) = delete;
+
+        // Serves packets until the client resumes execution or goes away.
+        // stopReply is sent first unless it is empty.
+        void serve(const std::string& stopReply);
+
+        // Handles a packet, writing the reply. Returns true if execution resumes.
+        bool handle(const std::string& packet, std::string& reply);
+
+        bool readPacket(std::string& packet);
+        bool readByte(char& c);
+        bool sendPacket(const std::string& data);
+        bool sendAll(const char* data, size_t length);
+
+        std::string readRegisters() const;
+        void writeRegisters(const std::string& hex);
+        bool setPoint(char type, uint16_t addr, uint16_t length, bool insert);
+
+        bool listenTcp(const std::string& host, uint16_t port);
+        bool listenUnix(const std::string& path);
+        // Closes the listener again on failure.
+        bool startListening();
+
+        void detach();
+        void updateHook();
+
+        yb::Emulator* emulator_;
+
+        int listener_;
+        int client_;
+        std::string unixPath_;
+
+        std::string inbox_;
+        size_t inboxPos_;
+
+        yb::BreakpointSet breakpoints_;
+        std::map<uint16_t, uint8_t> watchpoints_;
+        std::string watchReply_;
+        // Machine cycle of the last stop, so that continuing from a breakpoint
+        // doesn't stop at it again.
+        uint64_t stopCycle_;
+
+        bool stepping_;
+        bool hooked_;
+        bool lockReported_;
+    };
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace yb {
+
+    // 64-bit xxHash (XXH64). Four independent accumulator lanes keep it fast on
+    // framebuffers and save states, which is where it is used.
+    uint64_t hash64(const void* data, size_t size, uint64_t seed = 0);
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+#include "cpu.h"
+
+namespace yb {
+
+    // An executed instruction, as seen by hooks.
+    struct Step {
+        uint16_t pc;
+        // ROM bank pc was mapped to, 0 outside of ROM
+        uint8_t bank;
+        uint8_t op;
+        // The two bytes following the opcode, whatever the instruction's length.
+        uint8_t operands[2];
+        uint8_t cycles;
+        // Machine cycles elapsed once the instruction completed.
+        uint64_t cycle;
+    };
+
+    // Observes every executed instruction. Installing a hook moves the emulator
+    // onto an instrumented frame loop; with no hooks the plain loop runs untouched.
+    class InstructionHook
+    {
+    public:
+        virtual ~InstructionHook() = default;
+
+        // Called after the instruction ran; cpu holds the resulting state.
+        virtual void onInstruction(const yb::CPU& cpu, const yb::Step& step) = 0;
+    };
+
+    // Called after every completed frame. Unlike instruction hooks these cost
+    // nothing per instruction, so they suit anything that only needs to poll.
+    class FrameHook
+    {
+    public:
+        virtual ~FrameHook() = default;
+
+        virtual void onFrame() = 0;
+    };
+
+    // Called before instructions starting on a page the emulator was asked to
+    // watch (see Emulator::watchExec), for execution breakpoints. The hook
+    // checks the exact address itself.
+    class ExecHook
+    {
+    public:
+        virtual ~ExecHook() = default;
+
+        virtual void onExec(uint16_t pc) = 0;
+    };
+
+    // Called once, after the instruction that requested it has completed (see
+    // Emulator::requestBreak). Lets whatever notices a reason to stop in the
+    // middle of an instruction, like a watchpoint, act on it without hooking
+    // every instruction.
+    class BreakHook
+    {
+    public:
+        virtual ~BreakHook() = default;
+
+        virtual void onBreak() = 0;
+    };
+
+}
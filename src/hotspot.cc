@@ -0,0 +1,149 @@
+#include "hotspot.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+#include "hash.h"
+
+yb::HotspotProfiler::HotspotProfiler(const yb::MMU* mmu, uint32_t interval, size_t capacity)
+    : mmu_(mmu)
+    , interval_(interval ? interval : 1)
+    , untilSample_(interval_)
+    , dropped_(0)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    slots_.reset(new Slot[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+        slots_[i].key.store(0, std::memory_order_relaxed);
+        slots_[i].count.store(0, std::memory_order_relaxed);
+        slots_[i].ready.store(false, std::memory_order_relaxed);
+        slots_[i].depth = 0;
+    }
+}
+
+void yb::HotspotProfiler::onInstruction(const yb::CPU& cpu, const yb::Step& step)
+{
+    // the instruction's cycles are charged to the stack it ran in
+    if (step.cycles >= untilSample_) {
+        untilSample_ = interval_ - (step.cycles - untilSample_) % interval_;
+        sample((uint32_t) step.bank << 16 | step.pc);
+    } else {
+        untilSample_ -= step.cycles;
+    }
+
+    const uint16_t pc = cpu.PC.value;
+    switch (step.op) {
+    // CALL
+    case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+        if (pc != (uint16_t)(step.pc + 3)) {
+            stack_.push_back(Frame{ (uint32_t) mmu_->bankAt(pc) << 16 | pc, (uint16_t)(step.pc + 3) });
+        }
+        break;
+    // RST
+    case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+        stack_.push_back(Frame{ pc, (uint16_t)(step.pc + 1) });
+        break;
+    // RET, RET cc and RETI
+    case 0xC9: case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xD9:
+        // unwind to the frame this returns to; returns that match no frame
+        // (stack tricks, jumps through pushed addresses) leave the stack alone
+        for (size_t depth = stack_.size(); depth > 0; --depth) {
+            if (stack_[depth - 1].returnAddr == pc) {
+                stack_.resize(depth - 1);
+                break;
+            }
+        }
+        break;
+    }
+}
+
+void yb::HotspotProfiler::sample(uint32_t leaf)
+{
+    // keep the innermost frames of deep stacks
+    uint32_t frames[MAX_DEPTH];
+    const size_t callers = stack_.size() < MAX_DEPTH - 1 ? stack_.size() : MAX_DEPTH - 1;
+    for (size_t i = 0; i < callers; ++i) {
+        frames[i] = stack_[stack_.size() - callers + i].target;
+    }
+    frames[callers] = leaf;
+    const uint8_t depth = callers + 1;
+
+    uint64_t key = yb::hash64(frames, depth * sizeof(uint32_t));
+    if (key == 0) {
+        key = 1;
+    }
+
+    for (size_t probe = 0; probe <= mask_; ++probe) {
+        Slot& slot = slots_[(key + probe) & mask_];
+
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if (current == 0) {
+            if (slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                slot.depth = depth;
+                std::copy(frames, frames + depth, slot.frames);
+                slot.ready.store(true, std::memory_order_release);
+                slot.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            // lost the race for this slot; current now holds the winner's key
+        }
+
+        if (current == key) {
+            slot.count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void yb::HotspotProfiler::exportCollapsed(std::FILE* out, const yb::SymbolTable& symbols) const
+{
+    // distinct addresses resolve to the same routine names, so merge by name
+    std::map<std::string, uint64_t> stacks;
+
+    for (size_t i = 0; i <= mask_; ++i) {
+        const Slot& slot = slots_[i];
+        if (!slot.ready.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        std::string line;
+        std::string caller;
+        for (uint8_t f = 0; f < slot.depth; ++f) {
+            const uint8_t bank = slot.frames[f] >> 16;
+            const uint16_t addr = slot.frames[f] & 0xFFFF;
+
+            // the leaf is attributed to the routine containing it, which is
+            // usually the innermost callee itself
+            const char* label = f + 1 == slot.depth ? symbols.lookup(bank, addr) : nullptr;
+            const std::string name = label ? label : symbols.describe(bank, addr);
+            if (f != 0 && label && name == caller) {
+                break;
+            }
+
+            if (f != 0) {
+                line += ';';
+            }
+            line += name;
+            caller = name;
+        }
+
+        stacks[line] += slot.count.load(std::memory_order_relaxed);
+    }
+
+    for (const auto& stack : stacks) {
+        std::fprintf(out, "%s %llu\n", stack.first.c_str(), (unsigned long long) stack.second);
+    }
+}
+
+uint64_t yb::HotspotProfiler::dropped() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
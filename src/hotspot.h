@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "hook.h"
+#include "mmu.h"
+#include "symbols.h"
+
+namespace yb {
+
+    // Sampling profiler for guest code. Every interval cycles it records the
+    // current bank:PC together with the chain of CALL/RST targets leading to it,
+    // tracked in a shadow call stack, and aggregates identical stacks in a
+    // fixed-size lock-free hash table.
+    class HotspotProfiler : public yb::InstructionHook
+    {
+    public:
+        static constexpr size_t MAX_DEPTH = 64;
+
+        // The MMU resolves the banks of call targets.
+        HotspotProfiler(const yb::MMU* mmu, uint32_t interval, size_t capacity = 1 << 16);
+
+        void onInstruction(const yb::CPU& cpu, const yb::Step& step) override;
+
+        // Writes the samples in the collapsed stack format used by flamegraph.pl
+        // and similar tools: "outer;inner;leaf count" per line.
+        void exportCollapsed(std::FILE* out, const yb::SymbolTable& symbols) const;
+
+        // Samples lost because the table was full.
+        uint64_t dropped() const;
+
+    private:
+        struct Frame {
+            uint32_t target;    // bank << 16 | addr of the called routine
+            uint16_t returnAddr;
+        };
+
+        struct Slot {
+            std::atomic<uint64_t> key;
+            std::atomic<uint64_t> count;
+            std::atomic<bool> ready;
+            uint8_t depth;
+            uint32_t frames[MAX_DEPTH];
+        };
+
+        void sample(uint32_t leaf);
+
+        const yb::MMU* mmu_;
+
+        uint32_t interval_;
+        uint32_t untilSample_;
+
+        std::vector<Frame> stack_;
+
+        std::unique_ptr<Slot[]> slots_;
+        size_t mask_;
+        std::atomic<uint64_t> dropped_;
+    };
+
+}
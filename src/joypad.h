@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+namespace yb {
+
+    // Joypad buttons as bit flags; a set bit means the button is held.
+    // The low nibble mirrors the direction lines of P1, the high nibble the action lines.
+    enum Button : uint8_t
+    {
+        BUTTON_RIGHT  = 1 << 0,
+        BUTTON_LEFT   = 1 << 1,
+        BUTTON_UP     = 1 << 2,
+        BUTTON_DOWN   = 1 << 3,
+        BUTTON_A      = 1 << 4,
+        BUTTON_B      = 1 << 5,
+        BUTTON_SELECT = 1 << 6,
+        BUTTON_START  = 1 << 7
+    };
+
+}
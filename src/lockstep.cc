@@ -0,0 +1,179 @@
+#include "lockstep.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace yb {
+
+static bool same_writes(const std::vector<yb::MemoryWrite>& a, const std::vector<yb::MemoryWrite>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].addr != b[i].addr || a[i].value != b[i].value) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static std::string format_writes(const std::vector<yb::MemoryWrite>& writes)
+{
+    if (writes.empty()) {
+        return "none";
+    }
+
+    std::string text;
+    for (const yb::MemoryWrite& write : writes) {
+        char entry[16];
+        std::snprintf(entry, sizeof(entry), "%s$%04X=$%02X", text.empty() ? "" : " ", write.addr, write.value);
+        text += entry;
+    }
+
+    return text;
+}
+
+} // end namespace
+
+int yb::run_lockstep(yb::Emulator& reference, yb::Emulator& candidate, const yb::InputScript& input, int frames)
+{
+    std::vector<yb::MemoryWrite> referenceWrites;
+    std::vector<yb::MemoryWrite> candidateWrites;
+    reference.mmu().setWriteLog(&referenceWrites);
+    candidate.mmu().setWriteLog(&candidateWrites);
+
+    int status = 0;
+    uint64_t instructions = 0;
+
+    for (int frame = 0; frame < frames && status == 0; ++frame) {
+        reference.setInput(input.buttonsAt(frame));
+        candidate.setInput(input.buttonsAt(frame));
+
+        bool frameDone = false;
+        while (!frameDone) {
+            referenceWrites.clear();
+            candidateWrites.clear();
+
+            yb::Step referenceStep;
+            yb::Step candidateStep;
+            frameDone = reference.step(referenceStep);
+            const bool candidateFrameDone = candidate.step(candidateStep);
+
+            const yb::TraceRecord expected = make_trace_record(reference.cpu(), referenceStep);
+            const yb::TraceRecord actual = make_trace_record(candidate.cpu(), candidateStep);
+
+            const bool sameState = same_trace_record(expected, actual);
+            const bool sameWrites = same_writes(referenceWrites, candidateWrites);
+            const bool sameFrame = frameDone == candidateFrameDone &&
+                (!frameDone || reference.frameHash() == candidate.frameHash());
+
+            if (!sameState || !sameWrites || !sameFrame) {
+                yb::error("Lockstep divergence at instruction %" PRIu64 " (frame %d):\n", instructions, frame);
+                yb::error("  reference: %s\n", format_trace_record(expected).c_str());
+                yb::error("  candidate: %s\n", format_trace_record(actual).c_str());
+                if (!sameWrites) {
+                    yb::error("  reference writes: %s\n", format_writes(referenceWrites).c_str());
+                    yb::error("  candidate writes: %s\n", format_writes(candidateWrites).c_str());
+                }
+                if (!sameFrame) {
+                    yb::error("  the rendered frames differ\n");
+                }
+                status = 1;
+                break;
+            }
+
+            ++instructions;
+        }
+    }
+
+    reference.mmu().setWriteLog(nullptr);
+    candidate.mmu().setWriteLog(nullptr);
+
+    if (status == 0) {
+        std::printf("Lockstep run agreed on %" PRIu64 " instructions over %d frames.\n", instructions, frames);
+    }
+
+    return status;
+}
+
+yb::TraceVerifier::TraceVerifier()
+    : verified_(0)
+    , diverged_(false)
+    , exhausted_(false)
+{}
+
+bool yb::TraceVerifier::open(const char* path)
+{
+    return reader_.open(path);
+}
+
+void yb::TraceVerifier::onInstruction(const yb::CPU& cpu, const yb::Step& step)
+{
+    if (diverged_ || exhausted_) {
+        return;
+    }
+
+    yb::TraceRecord expected;
+    if (!reader_.next(expected)) {
+        // a damaged trace can't vouch for anything
+        diverged_ = !reader_.ok();
+        exhausted_ = reader_.ok();
+        return;
+    }
+
+    const yb::TraceRecord actual = make_trace_record(cpu, step);
+    if (!same_trace_record(expected, actual)) {
+        yb::error("Divergence from the trace at instruction %" PRIu64 ":\n", verified_);
+        yb::error("  expected: %s\n", format_trace_record(expected).c_str());
+        yb::error("  actual:   %s\n", format_trace_record(actual).c_str());
+        diverged_ = true;
+        return;
+    }
+
+    ++verified_;
+}
+
+bool yb::TraceVerifier::diverged() const
+{
+    return diverged_;
+}
+
+bool yb::TraceVerifier::exhausted() const
+{
+    return exhausted_;
+}
+
+uint64_t yb::TraceVerifier::verified() const
+{
+    return verified_;
+}
+
+int yb::run_trace_verification(yb::Emulator& emulator, const yb::InputScript& input, int frames, const char* tracePath)
+{
+    yb::TraceVerifier verifier;
+    if (!verifier.open(tracePath)) {
+        return 1;
+    }
+
+    emulator.addHook(&verifier);
+    for (int frame = 0; frame < frames && !verifier.diverged() && !verifier.exhausted(); ++frame) {
+        emulator.setInput(input.buttonsAt(frame));
+        emulator.runFrame();
+    }
+    emulator.removeHook(&verifier);
+
+    if (verifier.diverged()) {
+        return 1;
+    }
+
+    std::printf("%" PRIu64 " instructions match %s%s.\n", verifier.verified(), tracePath,
+        verifier.exhausted() ? "" : " (stopped at the frame limit)");
+    return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+#include "emulator.h"
+#include "hook.h"
+#include "regression.h"
+#include "trace.h"
+
+namespace yb {
+
+    // Runs two emulators one instruction at a time from the same state and
+    // stops at the first instruction after which they differ in registers,
+    // flags, cycle count, memory writes or rendered frames. The candidate is
+    // typically a clone of the reference running a different CPU backend.
+    // Returns 0 if they agreed for the whole run, 1 otherwise.
+    int run_lockstep(yb::Emulator& reference, yb::Emulator& candidate, const yb::InputScript& input, int frames);
+
+    // Compares every executed instruction against a trace recorded earlier
+    // with yb::TraceWriter and reports the first difference.
+    class TraceVerifier : public yb::InstructionHook
+    {
+    public:
+        TraceVerifier();
+
+        bool open(const char* path);
+
+        void onInstruction(const yb::CPU& cpu, const yb::Step& step) override;
+
+        bool diverged() const;
+
+        // True once every recorded instruction was matched.
+        bool exhausted() const;
+
+        uint64_t verified() const;
+
+    private:
+        yb::TraceReader reader_;
+        uint64_t verified_;
+        bool diverged_;
+        bool exhausted_;
+    };
+
+    // Runs the emulator headlessly under a TraceVerifier until the trace ends,
+    // a difference shows up or the frame limit is reached.
+    // Returns 0 if everything executed matched the trace, 1 otherwise.
+    int run_trace_verification(yb::Emulator& emulator, const yb::InputScript& input, int frames, const char* tracePath);
+
+}
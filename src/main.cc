@@ -2,83 +2,235 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "batch.h"
 #include "common.h"
+#include "coverage.h"
+#include "debugger.h"
 #include "emulator.h"
+#include "gdb_server.h"
+#include "hotspot.h"
+#include "lockstep.h"
+#include "movie.h"
+#include "regression.h"
+#include "save_ram.h"
+#include "symbols.h"
+#include "trace.h"
+#include "video.h"
 
 static void print_help()
 {
     std::puts("yoBoy -- The GameBoy emulator.");
 
-    std::puts("Usage: yoBoy '/path/to/rom.gb' [-h]");
+    std::puts("Usage: yoBoy '/path/to/rom.gb' [-h] [--run-ahead N] [--filter NAME] [--scale N] [--ppu NAME] [--debug | --gdb ADDR]");
+    std::puts("       yoBoy --batch <dir|list> [--frames N] [--jobs N]");
+    std::puts("       yoBoy '/path/to/rom.gb' (--golden FILE | --record-golden FILE) [--frames N] [--input FILE]");
+    std::puts("       yoBoy '/path/to/rom.gb' (--lockstep | --verify-trace FILE) [--frames N] [--input FILE]");
+    std::puts("       yoBoy '/path/to/rom.gb' (--record-movie FILE | --play-movie FILE)");
     std::putchar('\n');
 
     std::puts("Optional arguments:");
     std::puts("-h            show this help message and exit.");
+    std::puts("--run-ahead N emulate N frames ahead of the displayed one to cut input latency.");
+    std::puts("--filter NAME upscaling filter: nearest (default), scale2x, scale3x, xbr2x or xbr4x.");
+    std::puts("--scale N     window scale of the nearest filter (default 3).");
+    std::puts("--ppu NAME    PPU renderer: scanline, fifo or auto (default), which draws");
+    std::puts("              lines with registers written mid-line through the FIFO.");
+    std::puts("--batch SRC   run every ROM in directory SRC (or listed in file SRC) headlessly");
+    std::puts("              and print one JSON line of results per ROM.");
+    std::puts("--frames N    number of frames batch and regression runs last (default 600).");
+    std::puts("--jobs N      number of batch worker threads (default: one per core).");
+    std::puts("--golden F    run headlessly and compare every frame's hash against golden file F.");
+    std::puts("--record-golden F");
+    std::puts("              run headlessly and write every frame's hash to golden file F.");
+    std::puts("--input F     scripted joypad input for headless runs.");
+    std::puts("--lockstep    run a cloned second machine in lockstep and stop at the first");
+    std::puts("              instruction after which their state or memory writes differ.");
+    std::puts("--verify-trace F");
+    std::puts("              run headlessly and compare every instruction against trace F.");
+    std::puts("--hotspots F  sample guest code and write collapsed stacks for flamegraphs to F.");
+    std::puts("--hotspot-interval N");
+    std::puts("              cycles between hotspot samples (default 1024).");
+    std::puts("--coverage F  write a report of the executed and never executed ROM to F.");
+    std::puts("--sym F       RGBDS symbol file used to name hotspot frames and coverage ranges.");
+    std::puts("--trace F     record every executed instruction to binary trace file F");
+    std::puts("              (read it back with yoboy-trace).");
+    std::puts("--record F    record every frame to YUV4MPEG2 video file F from a background");
+    std::puts("              thread; frames the disk can't keep up with are dropped.");
+    std::puts("--debug       start in the interactive debugger; Ctrl-C breaks back into it.");
+    std::puts("--gdb ADDR    serve the GDB remote protocol at [HOST:]PORT (localhost by");
+    std::puts("              default), or on the Unix socket unix:PATH or at any PATH with a /.");
+    std::puts("--record-movie F");
+    std::puts("              record the joypad input of every frame to movie F.");
+    std::puts("--play-movie F");
+    std::puts("              replay movie F headlessly at full speed and check that it ends");
+    std::puts("              in the recorded state.");
     std::putchar('\n');
 }
 
-static size_t fsize(std::FILE *file)
-{
-    size_t curr = std::ftell(file);
-    std::fseek(file, 0, SEEK_END);
-
-    size_t size = std::ftell(file);
-
-    std::fseek(file, curr, SEEK_SET);
-
-    return size;
-}
-
-static yb::Cartridge read_cartridge(const char* path)
-{
-    std::FILE *file = std::fopen(path, "rb");
-    if (!file) {
-        return std::vector<std::uint8_t>{};
-    }
-
-    size_t fileSize = fsize(file);
-
-    std::vector<std::uint8_t> mem(fileSize, 0);
-
-    size_t bytesRead = std::fread(mem.data(), sizeof(uint8_t), fileSize, file);
-    if (bytesRead != fileSize) {
-        std::fclose(file);
-
-        return std::vector<std::uint8_t>{};
-    }
-
-    std::fclose(file);
-
-    return mem;
-}
-
 struct Args {
     std::string cartridge_path;
     bool print_help;
+    int run_ahead;
+    yb::Filter filter;
+    yb::PPUEngine ppu;
+    int scale;
+    std::string batch_source;
+    int frames;
+    int jobs;
+    std::string golden_path;
+    bool record_golden;
+    std::string input_path;
+    std::string hotspots_path;
+    int hotspot_interval;
+    std::string sym_path;
+    std::string coverage_path;
+    bool debug;
+    std::string gdb_address;
+    std::string trace_path;
+    bool lockstep;
+    std::string verify_path;
+    std::string record_movie_path;
+    std::string play_movie_path;
+    std::string record_path;
 };
 
-static Args parse_args(int argc, char **argv)
+static int parse_int(const char* flag, const char* value)
 {
-    Args args;
-    if (argc < 2) {
-        return args;
+    char* end = nullptr;
+    const long n = std::strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < 0) {
+        yb::exit("Invalid value %s for %s.\n", value, flag);
     }
 
-    if (std::strcmp("-h", argv[1]) == 0) {
-        args.print_help = true;
-        return args;
-    }
+    return (int) n;
+}
 
-    args.cartridge_path = argv[1];
+static Args parse_args(int argc, char **argv)
+{
+    Args args;
     args.print_help = false;
+    args.run_ahead = 0;
+    args.filter = yb::Filter::NEAREST;
+    args.ppu = yb::PPUEngine::AUTO;
+    args.scale = 3;
+    args.frames = 600;
+    args.jobs = 0;
+    args.record_golden = false;
+    args.hotspot_interval = 1024;
+    args.debug = false;
+    args.lockstep = false;
 
-    for (int i = 2; i < argc;) {
+    for (int i = 1; i < argc;) {
+        const bool hasValue = i + 1 < argc;
         if (std::strcmp(argv[i], "-h") == 0) {
             args.print_help = true;
             ++i;
         }
+        else if (std::strcmp(argv[i], "--run-ahead") == 0 && hasValue) {
+            args.run_ahead = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--filter") == 0 && hasValue) {
+            if (!yb::parse_filter(argv[i + 1], args.filter)) {
+                yb::exit("Invalid value %s for %s.\n", argv[i + 1], argv[i]);
+            }
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--scale") == 0 && hasValue) {
+            args.scale = parse_int(argv[i], argv[i + 1]);
+            if (args.scale < 1 || args.scale > 8) {
+                yb::exit("Invalid value %s for %s.\n", argv[i + 1], argv[i]);
+            }
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--ppu") == 0 && hasValue) {
+            if (!yb::parse_ppu_engine(argv[i + 1], args.ppu)) {
+                yb::exit("Invalid value %s for %s.\n", argv[i + 1], argv[i]);
+            }
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--batch") == 0 && hasValue) {
+            args.batch_source = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && hasValue) {
+            args.frames = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--jobs") == 0 && hasValue) {
+            args.jobs = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--golden") == 0 && hasValue) {
+            args.golden_path = argv[i + 1];
+            args.record_golden = false;
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--record-golden") == 0 && hasValue) {
+            args.golden_path = argv[i + 1];
+            args.record_golden = true;
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--input") == 0 && hasValue) {
+            args.input_path = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--hotspots") == 0 && hasValue) {
+            args.hotspots_path = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--hotspot-interval") == 0 && hasValue) {
+            args.hotspot_interval = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--coverage") == 0 && hasValue) {
+            args.coverage_path = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--sym") == 0 && hasValue) {
+            args.sym_path = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--debug") == 0) {
+            args.debug = true;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--lockstep") == 0) {
+            args.lockstep = true;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--verify-trace") == 0 && hasValue) {
+            args.verify_path = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && hasValue) {
+            args.trace_path = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--gdb") == 0 && hasValue) {
+            args.gdb_address = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--record-movie") == 0 && hasValue) {
+            args.record_movie_path = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--play-movie") == 0 && hasValue) {
+            args.play_movie_path = argv[i + 1];
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--record") == 0 && hasValue) {
+            args.record_path = argv[i + 1];
+            i += 2;
+        }
+        else if (argv[i][0] != '-' && args.cartridge_path.empty()) {
+            args.cartridge_path = argv[i];
+            ++i;
+        }
         else {
             yb::exit("Unrecognized argument %s.\n", argv[i]);
         }
@@ -87,6 +239,50 @@ static Args parse_args(int argc, char **argv)
     return args;
 }
 
+static bool write_hotspots(const yb::HotspotProfiler& hotspots, const yb::SymbolTable& symbols, const char* path)
+{
+    std::FILE* file = std::fopen(path, "w");
+    if (!file) {
+        yb::error("Could not write %s.\n", path);
+        return false;
+    }
+
+    hotspots.exportCollapsed(file, symbols);
+    std::fclose(file);
+
+    if (hotspots.dropped() != 0) {
+        yb::error("%llu hotspot samples were dropped: the sample table is full.\n",
+            (unsigned long long) hotspots.dropped());
+    }
+
+    return true;
+}
+
+// The ROM's path with its extension, if any, replaced by .sav.
+static std::string save_path(const std::string& rom)
+{
+    const size_t slash = rom.find_last_of('/');
+    const size_t dot = rom.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return rom + ".sav";
+    }
+
+    return rom.substr(0, dot) + ".sav";
+}
+
+static bool write_coverage(const yb::Coverage& coverage, const yb::SymbolTable& symbols, const char* path)
+{
+    std::FILE* file = std::fopen(path, "w");
+    if (!file) {
+        yb::error("Could not write %s.\n", path);
+        return false;
+    }
+
+    coverage.report(file, symbols);
+    std::fclose(file);
+
+    return true;
+}
 
 int main(int argc, char **argv)
 {
@@ -96,16 +292,177 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (!args.batch_source.empty()) {
+        return yb::run_batch(args.batch_source, args.frames, args.jobs) == 0 ? 0 : 1;
+    }
+
     if (args.cartridge_path.empty()) {
         yb::exit("The GameBoy ROM file was not supplied.\n");
     }
 
-    auto cartridge = read_cartridge(args.cartridge_path.c_str());
+    if (args.debug && !args.gdb_address.empty()) {
+        yb::exit("--debug and --gdb cannot be used together.\n");
+    }
+
+    // watchpoints would stop on speculative frames that are then rolled back
+    if (args.run_ahead > 0 && (args.debug || !args.gdb_address.empty())) {
+        yb::exit("--run-ahead cannot be used with --debug or --gdb.\n");
+    }
+
+    const bool regression = !args.golden_path.empty();
+    const bool verify = !args.verify_path.empty();
+    const bool replay = !args.play_movie_path.empty();
+    const bool headless = regression || args.lockstep || verify || replay;
+    // the text trace would drown the debugger's prompt and throttle binary tracing
+    if (headless || args.debug || !args.gdb_address.empty() || !args.trace_path.empty()) {
+        yb::log_enabled() = false;
+    }
+
+    auto cartridge = yb::read_cartridge(args.cartridge_path.c_str());
     if (cartridge.empty()) {
         yb::exit("Could not read %s.\n", args.cartridge_path.c_str());
     }
 
-    yb::Emulator emulator(cartridge);
+    if (!cartridge.isSupported()) {
+        yb::exit("Only ROM_ONLY and ROM+RAM cartridges are currently supported.\n");
+    }
+
+    yb::InputScript input;
+    if (!args.input_path.empty() && !input.load(args.input_path.c_str())) {
+        return 1;
+    }
+
+    yb::SymbolTable symbols;
+    if (!args.sym_path.empty() && !symbols.load(args.sym_path.c_str())) {
+        return 1;
+    }
+
+    yb::Movie movie;
+    if (replay && !movie.load(args.play_movie_path.c_str())) {
+        return 1;
+    }
+
+    yb::Emulator emulator(cartridge, headless);
+    emulator.setRunAhead(args.run_ahead);
+    emulator.setFilter(args.filter, args.scale);
+    emulator.setPPUEngine(args.ppu);
+
+    // Headless runs have to be reproducible and movies replay headlessly, so
+    // neither starts from or changes the game's save.
+    yb::SaveRam save;
+    if (!headless && args.record_movie_path.empty() && cartridge.hasBattery() && cartridge.ramSize() > 0) {
+        if (!save.open(save_path(args.cartridge_path), cartridge.ramSize())) {
+            return 1;
+        }
+        emulator.mmu().setCartridgeRam(save.data(), save.size());
+    }
+
+    std::unique_ptr<yb::HotspotProfiler> hotspots;
+    if (!args.hotspots_path.empty()) {
+        hotspots.reset(new yb::HotspotProfiler(&emulator.mmu(), args.hotspot_interval));
+        emulator.addHook(hotspots.get());
+    }
+
+    std::unique_ptr<yb::Coverage> coverage;
+    if (!args.coverage_path.empty()) {
+        coverage.reset(new yb::Coverage(emulator.cartridge()));
+        emulator.addHook(coverage.get());
+    }
+
+    yb::TraceWriter trace;
+    if (!args.trace_path.empty()) {
+        if (!trace.open(args.trace_path.c_str())) {
+            return 1;
+        }
+        emulator.addHook(&trace);
+    }
+
+    yb::VideoRecorder video(&emulator);
+    if (!args.record_path.empty() && !video.open(args.record_path.c_str())) {
+        return 1;
+    }
+
+    std::unique_ptr<yb::Debugger> debugger;
+    if (args.debug) {
+        debugger.reset(new yb::Debugger(&emulator));
+        debugger->prompt();
+    }
+
+    std::unique_ptr<yb::GdbServer> gdb;
+    if (!args.gdb_address.empty()) {
+        gdb.reset(new yb::GdbServer(&emulator));
+        if (!gdb->listen(args.gdb_address)) {
+            return 1;
+        }
+    }
+
+    int status = 0;
+    if (regression) {
+        status = yb::run_regression(emulator, input, args.frames, args.golden_path.c_str(), args.record_golden);
+    } else if (args.lockstep) {
+        // the clone goes through a save state, so this also checks that
+        // save states capture everything that affects execution
+        yb::Emulator candidate(cartridge, true);
+        candidate.setPPUEngine(args.ppu);
+        std::vector<uint8_t> state;
+        emulator.saveState(state);
+        if (!candidate.loadState(state.data(), state.size())) {
+            yb::exit("Could not clone the machine state.\n");
+        }
+        status = yb::run_lockstep(emulator, candidate, input, args.frames);
+    } else if (verify) {
+        status = yb::run_trace_verification(emulator, input, args.frames, args.verify_path.c_str());
+    } else if (replay) {
+        status = yb::play_movie(emulator, movie);
+    } else {
+        std::unique_ptr<yb::MovieRecorder> recorder;
+        if (!args.record_movie_path.empty()) {
+            movie.setRomHash(yb::rom_hash(emulator.cartridge()));
+            recorder.reset(new yb::MovieRecorder(&emulator, &movie));
+        }
+
+        emulator.start();
+#ifdef YB_PROFILE
+        emulator.cpu().profile().report(stderr);
+#endif
+
+        if (recorder) {
+            recorder.reset();
+            movie.setFinalHash(yb::state_hash(emulator));
+            if (!movie.save(args.record_movie_path.c_str())) {
+                status = 1;
+            }
+        }
+
+        if (emulator.isLocked()) {
+            yb::error("Emulation stopped: the CPU locked up.\n");
+            status = 1;
+        }
+    }
+
+    if (!trace.close()) {
+        status = 1;
+    }
+
+    if (!save.close()) {
+        status = 1;
+    }
+
+    if (!args.record_path.empty()) {
+        if (!video.close()) {
+            status = 1;
+        }
+        std::printf("Recorded %llu frames to %s, dropped %llu.\n",
+            (unsigned long long) video.frames(), args.record_path.c_str(), (unsigned long long) video.dropped());
+    }
+
+    if (hotspots && !write_hotspots(*hotspots, symbols, args.hotspots_path.c_str())) {
+        status = 1;
+    }
+
+    if (coverage && !write_coverage(*coverage, symbols, args.coverage_path.c_str())) {
+        status = 1;
+    }
 
-    emulator.start();
+    return status;
 }
@@ -1,38 +1,854 @@
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 
 #include "mmu.h"
 
-yb::MMU::MMU(uint8_t* cartridge)
+static constexpr uint16_t P1 = 0xFF00;
+static constexpr uint16_t SB = 0xFF01;
+static constexpr uint16_t SC = 0xFF02;
+static constexpr uint16_t IF = 0xFF0F;
+static constexpr uint16_t STAT = 0xFF41;
+static constexpr uint16_t DMA = 0xFF46;
+static constexpr uint16_t OAM = 0xFE00;
+static constexpr uint16_t HRAM = 0xFF80;
+
+static constexpr size_t OAM_SIZE = 160;
+static constexpr uint64_t OAM_DMA_CYCLES = 640;
+
+// CGB registers
+static constexpr uint16_t KEY1  = 0xFF4D;
+static constexpr uint16_t VBK   = 0xFF4F;
+static constexpr uint16_t HDMA1 = 0xFF51;
+static constexpr uint16_t HDMA2 = 0xFF52;
+static constexpr uint16_t HDMA3 = 0xFF53;
+static constexpr uint16_t HDMA4 = 0xFF54;
+static constexpr uint16_t HDMA5 = 0xFF55;
+static constexpr uint16_t BCPS  = 0xFF68;
+static constexpr uint16_t BCPD  = 0xFF69;
+static constexpr uint16_t OCPS  = 0xFF6A;
+static constexpr uint16_t OCPD  = 0xFF6B;
+static constexpr uint16_t SVBK  = 0xFF70;
+
+static constexpr uint8_t ROM_PAGES = 0x8000 >> YB_PAGE_SHIFT;
+static constexpr uint8_t IO_PAGE = 0xFF00 >> YB_PAGE_SHIFT;
+static constexpr uint8_t VRAM_PAGE = 0x8000 >> YB_PAGE_SHIFT;
+static constexpr uint8_t VRAM_PAGES = YB_VRAM_BANK_SIZE / YB_PAGE_SIZE;
+static constexpr uint8_t WRAM_PAGE = 0xC000 >> YB_PAGE_SHIFT;
+static constexpr uint8_t BANKED_WRAM_PAGE = 0xD000 >> YB_PAGE_SHIFT;
+static constexpr uint8_t CART_RAM_PAGE = 0xA000 >> YB_PAGE_SHIFT;
+static constexpr uint8_t CART_RAM_PAGES = 0x2000 / YB_PAGE_SIZE;
+
+static constexpr uint16_t HDMA_BLOCK = 16;
+
+// What unbacked blocks other than ROM read as.
+static const uint8_t ZEROES[YB_VRAM_BANK_SIZE] = {};
+
+static const uint8_t* contents(const yb::SharedBlock& block, const uint8_t* initial)
+{
+    return block.data() ? block.data() : initial;
+}
+
+// LCDC, SCY, SCX, BGP, OBP0, OBP1, WY and WX: what the PPU reads while it
+// draws. LY, STAT, LYC and DMA don't change the picture.
+static bool is_display_register(uint16_t addr)
+{
+    switch (addr) {
+    case 0xFF40:
+    case 0xFF42:
+    case 0xFF43:
+    case 0xFF47:
+    case 0xFF48:
+    case 0xFF49:
+    case 0xFF4A:
+    case 0xFF4B:
+        return true;
+    default:
+        return false;
+    }
+}
+
+yb::MMU::MMU(const uint8_t* cartridge, bool cgb)
     : cartridge_(cartridge)
+    , cartRam_(nullptr)
+    , cartRamPages_(0)
+    , watchListener_(nullptr)
+    , displayListener_(nullptr)
+    , writeLog_(nullptr)
+    , joypad_(0)
+    , oamGeneration_(0)
+    , clock_(nullptr)
+    , dmaEnd_(0)
+    , cgb_(cgb)
+    , vramBank_(0)
+    , wramBank_(1)
+    , doubleSpeed_(false)
+    , hdmaSource_(0)
+    , hdmaDest_(0x8000)
+    , hdmaBlocks_(0)
 {
-    std::memset(ram_, 0, sizeof(uint8_t) * YB_MEM_SIZE);
-    
-    // TODO: for now, assume MCB zero and copy entirety of game into first two ROM banks
-    std::memcpy(ram_, cartridge_, 0x8000 * sizeof(uint8_t));
+    std::memset(io_, 0, sizeof(io_));
+    // the boot ROM leaves every color white
+    std::memset(bgPalettes_, 0xFF, sizeof(bgPalettes_));
+    std::memset(objPalettes_, 0xFF, sizeof(objPalettes_));
+
+    io(P1) = 0x30;
+    refreshJoypad();
+
+    if (cgb_) {
+        io(KEY1) = 0x7E;
+        io(VBK) = 0xFE;
+        io(HDMA5) = 0xFF;
+        io(BCPS) = 0x40;
+        io(BCPD) = bgPalettes_[0];
+        io(OCPS) = 0x40;
+        io(OCPD) = objPalettes_[0];
+        io(SVBK) = 0xF8;
+    }
+
+    std::memset(pageWatches_, 0, sizeof(pageWatches_));
+    mapMemory();
 }
 
-uint8_t yb::MMU::read8(uint16_t addr) const
+uint8_t* yb::SharedBlock::data() const
 {
-    // TODO: add checks
-    return ram_[addr];
+    return data_.get();
 }
 
-uint16_t yb::MMU::read16(uint16_t addr) const
+bool yb::SharedBlock::isShared() const
 {
-    // TODO: add checks
-    const uint16_t value = (uint16_t)ram_[addr + 1] << 8 | ram_[addr];
+    if (!data_ || data_.use_count() > 1) {
+        return true;
+    }
+
+    // pairs with the release of the reference another MMU dropped, so that
+    // its last reads of the memory happen before our writes
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return false;
+}
+
+bool yb::SharedBlock::own(const uint8_t* current, size_t size)
+{
+    if (!isShared()) {
+        return false;
+    }
+
+    std::shared_ptr<uint8_t> copy(new uint8_t[size], std::default_delete<uint8_t[]>());
+    std::memcpy(copy.get(), current, size);
+    data_ = std::move(copy);
+
+    return true;
+}
+
+void yb::SharedBlock::assign(const uint8_t* bytes, size_t size)
+{
+    if (!own(bytes, size)) {
+        std::memcpy(data_.get(), bytes, size);
+    }
+}
+
+uint8_t yb::MMU::read8(uint16_t addr)
+{
+    const uint8_t* page = readPages_[addr >> YB_PAGE_SHIFT];
+    if (page) {
+        return page[addr & (YB_PAGE_SIZE - 1)];
+    }
+
+    return readSlow(addr);
+}
+
+uint16_t yb::MMU::read16(uint16_t addr)
+{
+    const uint16_t value = (uint16_t)read8(addr + 1) << 8 | read8(addr);
     return value;
 }
 
 void yb::MMU::write8(uint16_t addr, uint8_t value)
 {
-    // TODO: add checks
-    ram_[addr] = value;
+    uint8_t* page = writePages_[addr >> YB_PAGE_SHIFT];
+    if (page) {
+        page[addr & (YB_PAGE_SIZE - 1)] = value;
+        return;
+    }
+
+    writeSlow(addr, value);
 }
 
 void yb::MMU::write16(uint16_t addr, uint16_t value)
 {
-    // TODO: add checks
-    ram_[addr] = value >> 8;
-    ram_[addr + 1] = value & 0xFF;
-}
\ No newline at end of file
+    write8(addr, value >> 8);
+    write8(addr + 1, value & 0xFF);
+}
+
+uint8_t yb::MMU::readSlow(uint16_t addr)
+{
+    const uint8_t value = isBusLocked(addr) ? 0xFF : peek8(addr);
+
+    const auto watch = watches_.find(addr);
+    if (watch != watches_.end() && (watch->second & WATCH_READ) && watchListener_) {
+        watchListener_->onWatch(addr, value, false);
+    }
+
+    return value;
+}
+
+void yb::MMU::writeSlow(uint16_t addr, uint8_t value)
+{
+    if (writeLog_) {
+        writeLog_->push_back({ addr, value });
+    }
+
+    // most slow writes are to pages without watches
+    if (pageWatches_[addr >> YB_PAGE_SHIFT] & WATCH_WRITE) {
+        const auto watch = watches_.find(addr);
+        if (watch != watches_.end() && (watch->second & WATCH_WRITE) && watchListener_) {
+            watchListener_->onWatch(addr, value, true);
+        }
+    }
+
+    if (isBusLocked(addr)) {
+        return;
+    }
+
+    // TODO: ROM writes are MBC commands; ROM_ONLY cartridges ignore them
+    if (addr < 0x8000) {
+        return;
+    }
+
+    // mode 3: the PPU is drawing
+    if (displayListener_ && is_display_register(addr) && (io(STAT) & 0x03) == 0x03) {
+        displayListener_->onDisplayWrite(addr, value);
+    }
+
+    store8(addr, value);
+
+    if (displayListener_ && addr >= 0x8000 && addr < 0xA000) {
+        displayListener_->onVramWrite(cgb_ ? vramBank_ : 0, addr - 0x8000, 1);
+    }
+
+    if (cgb_ && (addr >> YB_PAGE_SHIFT) == (P1 >> YB_PAGE_SHIFT)) {
+        writeCGB(addr, value);
+    }
+
+    if (addr == P1) {
+        refreshJoypad();
+    }
+
+    if (addr == DMA) {
+        startOamDma(value);
+    }
+
+    if ((addr >> YB_PAGE_SHIFT) == (OAM >> YB_PAGE_SHIFT)) {
+        ++oamGeneration_;
+    }
+
+    // Serial transfer started with the internal clock. Nothing is ever connected,
+    // so the transfer completes at once and shifts in 0xFF.
+    if (addr == SC && (value & 0x81) == 0x81) {
+        serial_.push_back((char) io(SB));
+        io(SB) = 0xFF;
+        io(SC) = value & ~0x80;
+        io(IF) |= 0x08;
+    }
+}
+
+// The source page is contiguous in memory, so the transfer is one memcpy.
+void yb::MMU::startOamDma(uint8_t page)
+{
+    // the top of the map isn't reachable by DMA; it sees WRAM there like echo RAM does
+    if (page >= (0xE000 >> YB_PAGE_SHIFT)) {
+        page -= 0x20;
+    }
+    own(OAM >> YB_PAGE_SHIFT);
+    std::memcpy(memory_[OAM >> YB_PAGE_SHIFT], memory_[page], OAM_SIZE);
+    ++oamGeneration_;
+
+    if (clock_) {
+        dmaEnd_ = *clock_ + OAM_DMA_CYCLES;
+        for (int p = 0; p < YB_PAGE_COUNT; ++p) {
+            mapPage(p);
+        }
+    }
+}
+
+// True while an OAM DMA keeps the CPU off everything but HRAM. Ends the
+// lockout, mapping the pages back, once its time is up.
+bool yb::MMU::isBusLocked(uint16_t addr)
+{
+    if (dmaEnd_ == 0) {
+        return false;
+    }
+
+    if (*clock_ < dmaEnd_) {
+        return addr < HRAM || addr == 0xFFFF;
+    }
+
+    dmaEnd_ = 0;
+    for (int p = 0; p < YB_PAGE_COUNT; ++p) {
+        mapPage(p);
+    }
+
+    return false;
+}
+
+void yb::MMU::writeCGB(uint16_t addr, uint8_t value)
+{
+    switch (addr) {
+    case KEY1:
+        io(KEY1) = (doubleSpeed_ ? 0x80 : 0x00) | 0x7E | (value & 0x01);
+        break;
+    case VBK:
+        vramBank_ = value & 0x01;
+        io(VBK) = 0xFE | vramBank_;
+        mapBanks();
+        break;
+    case SVBK:
+        // bank 0 is always at 0xC000, so selecting it selects bank 1
+        wramBank_ = (value & 0x07) ? (value & 0x07) : 1;
+        io(SVBK) = 0xF8 | (value & 0x07);
+        mapBanks();
+        break;
+    case HDMA5:
+        // clearing bit 7 during an HBlank DMA stops it
+        if (hdmaBlocks_ > 0 && (value & 0x80) == 0) {
+            io(HDMA5) = 0x80 | (hdmaBlocks_ - 1);
+            hdmaBlocks_ = 0;
+            break;
+        }
+
+        hdmaSource_ = (io(HDMA1) << 8 | io(HDMA2)) & 0xFFF0;
+        hdmaDest_ = 0x8000 | ((io(HDMA3) << 8 | io(HDMA4)) & 0x1FF0);
+        if (value & 0x80) {
+            hdmaBlocks_ = (value & 0x7F) + 1;
+            io(HDMA5) = value & 0x7F;
+        } else {
+            copy(hdmaSource_, hdmaDest_, ((value & 0x7F) + 1) * HDMA_BLOCK);
+            io(HDMA5) = 0xFF;
+        }
+        break;
+    case BCPS:
+        io(BCPS) = value | 0x40;
+        io(BCPD) = bgPalettes_[value & 0x3F];
+        break;
+    case BCPD:
+        writePalette(BCPS, bgPalettes_, value);
+        break;
+    case OCPS:
+        io(OCPS) = value | 0x40;
+        io(OCPD) = objPalettes_[value & 0x3F];
+        break;
+    case OCPD:
+        writePalette(OCPS, objPalettes_, value);
+        break;
+    }
+}
+
+// Stores a byte through a palette's data port, at the index held in its
+// specification register, and advances the index if bit 7 asks for it.
+void yb::MMU::writePalette(uint16_t spec, uint8_t* palettes, uint8_t value)
+{
+    const uint8_t index = io(spec) & 0x3F;
+    palettes[index] = value;
+
+    if (io(spec) & 0x80) {
+        io(spec) = 0xC0 | ((index + 1) & 0x3F);
+    }
+    io(spec + 1) = palettes[io(spec) & 0x3F];
+}
+
+// DMA into VRAM: one memcpy per run that stays within a page on both sides.
+// Both addresses move past the copied bytes and the destination wraps within VRAM.
+void yb::MMU::copy(uint16_t src, uint16_t dst, size_t length)
+{
+    constexpr size_t mask = YB_PAGE_SIZE - 1;
+
+    while (length > 0) {
+        const size_t run = std::min({ length, YB_PAGE_SIZE - (src & mask), YB_PAGE_SIZE - (dst & mask) });
+        own(dst >> YB_PAGE_SHIFT);
+        std::memcpy(memory_[dst >> YB_PAGE_SHIFT] + (dst & mask), memory_[src >> YB_PAGE_SHIFT] + (src & mask), run);
+        if (displayListener_) {
+            displayListener_->onVramWrite(vramBank_, dst - 0x8000, run);
+        }
+
+        src = (uint16_t)(src + run);
+        dst = 0x8000 | ((dst + run) & 0x1FFF);
+        length -= run;
+    }
+
+    hdmaSource_ = src;
+    hdmaDest_ = dst;
+}
+
+void yb::MMU::mapBanks()
+{
+    for (int page = VRAM_PAGE; page < VRAM_PAGE + VRAM_PAGES; ++page) {
+        locate(page);
+    }
+
+    for (int page = WRAM_PAGE; page < WRAM_PAGE + 2 * YB_WRAM_BANK_SIZE / YB_PAGE_SIZE; ++page) {
+        locate(page);
+    }
+}
+
+void yb::MMU::mapMemory()
+{
+    for (int page = 0; page < YB_PAGE_COUNT; ++page) {
+        locate(page);
+    }
+}
+
+// Points page at its memory, or what stands in for it, and maps it. Nothing
+// writes through memory_ to the cartridge or ZEROES: unbacked blocks are
+// shared, so writes to them take the slow path, and direct writes own()
+// the page first.
+void yb::MMU::locate(uint8_t page)
+{
+    size_t offset;
+    size_t size;
+    const yb::SharedBlock* block = blockAt(page, offset, size);
+
+    if (page == IO_PAGE) {
+        memory_[page] = io_;
+    } else if (!block) {
+        memory_[page] = cartRam_ + (page - CART_RAM_PAGE) * YB_PAGE_SIZE;
+    } else if (block->data()) {
+        memory_[page] = block->data() + offset;
+    } else {
+        memory_[page] = const_cast<uint8_t*>(initial(page));
+    }
+
+    mapPage(page);
+}
+
+yb::SharedBlock* yb::MMU::blockAt(uint8_t page, size_t& offset, size_t& size)
+{
+    offset = 0;
+    size = YB_PAGE_SIZE;
+
+    if (page >= VRAM_PAGE && page < VRAM_PAGE + VRAM_PAGES) {
+        offset = (page - VRAM_PAGE) * YB_PAGE_SIZE;
+        size = YB_VRAM_BANK_SIZE;
+        return &vram_[vramBank_];
+    }
+
+    if (page >= WRAM_PAGE && page < BANKED_WRAM_PAGE) {
+        return &wram_[page - WRAM_PAGE];
+    }
+
+    if (page >= BANKED_WRAM_PAGE && page < BANKED_WRAM_PAGE + YB_WRAM_BANK_SIZE / YB_PAGE_SIZE) {
+        return &wram_[wramBank_ * (YB_WRAM_BANK_SIZE / YB_PAGE_SIZE) + page - BANKED_WRAM_PAGE];
+    }
+
+    if ((page >= CART_RAM_PAGE && page < CART_RAM_PAGE + cartRamPages_) || page == IO_PAGE) {
+        return nullptr;
+    }
+
+    return &pages_[page];
+}
+
+// The first two ROM banks, for MBC zero; ZEROES everywhere else.
+const uint8_t* yb::MMU::initial(uint8_t page) const
+{
+    if (page < ROM_PAGES) {
+        return cartridge_ + (page << YB_PAGE_SHIFT);
+    }
+
+    return ZEROES + (page >= VRAM_PAGE && page < VRAM_PAGE + VRAM_PAGES ? (page - VRAM_PAGE) * YB_PAGE_SIZE : 0);
+}
+
+void yb::MMU::own(uint8_t page)
+{
+    size_t offset;
+    size_t size;
+    yb::SharedBlock* block = blockAt(page, offset, size);
+    if (!block) {
+        return;
+    }
+
+    if (block->own(memory_[page] - offset, size)) {
+        if (size == YB_VRAM_BANK_SIZE) {
+            mapBanks();
+        } else {
+            locate(page);
+        }
+    } else if (!writePages_[page]) {
+        // the last fork sharing it may have let go since the page was mapped
+        mapPage(page);
+    }
+}
+
+// ROM is read only and the I/O page has side effects on write, so both
+// always write through the slow path, as do OAM and, for a display listener,
+// VRAM so that the PPU hears about changes to them. So do pages whose block
+// is shared, to copy it first. Watched pages go there for the watched kind
+// of access.
+void yb::MMU::mapPage(uint8_t page)
+{
+    uint8_t* memory = memory_[page];
+    size_t offset;
+    size_t size;
+    const yb::SharedBlock* block = blockAt(page, offset, size);
+    const bool shared = block && block->isShared();
+    const bool rom = page < ROM_PAGES;
+    const bool vram = displayListener_ && page >= VRAM_PAGE && page < VRAM_PAGE + VRAM_PAGES;
+    const bool io = page == (0xFF00 >> YB_PAGE_SHIFT);
+    const bool oam = page == (OAM >> YB_PAGE_SHIFT);
+    const bool dma = dmaEnd_ != 0;
+
+    readPages_[page] = (dma || (pageWatches_[page] & WATCH_READ)) ? nullptr : memory;
+    writePages_[page] = (rom || shared || vram || io || oam || dma || writeLog_ || (pageWatches_[page] & WATCH_WRITE)) ? nullptr : memory;
+}
+
+uint8_t& yb::MMU::io(uint16_t addr)
+{
+    return io_[addr & (YB_PAGE_SIZE - 1)];
+}
+
+void yb::MMU::watch(uint16_t addr, uint8_t flags)
+{
+    watches_[addr] |= flags;
+
+    const uint8_t page = addr >> YB_PAGE_SHIFT;
+    pageWatches_[page] |= flags;
+    mapPage(page);
+}
+
+void yb::MMU::unwatch(uint16_t addr, uint8_t flags)
+{
+    const auto watch = watches_.find(addr);
+    if (watch == watches_.end()) {
+        return;
+    }
+
+    watch->second &= ~flags;
+    if (watch->second == 0) {
+        watches_.erase(watch);
+    }
+
+    // recompute the page's flags from the addresses still watched in it
+    const uint8_t page = addr >> YB_PAGE_SHIFT;
+    pageWatches_[page] = 0;
+    for (const auto& w : watches_) {
+        if ((w.first >> YB_PAGE_SHIFT) == page) {
+            pageWatches_[page] |= w.second;
+        }
+    }
+    mapPage(page);
+}
+
+void yb::MMU::setWatchListener(yb::WatchListener* listener)
+{
+    watchListener_ = listener;
+}
+
+void yb::MMU::setDisplayListener(yb::DisplayListener* listener)
+{
+    displayListener_ = listener;
+
+    for (int page = VRAM_PAGE; page < VRAM_PAGE + VRAM_PAGES; ++page) {
+        mapPage(page);
+    }
+}
+
+void yb::MMU::setWriteLog(std::vector<yb::MemoryWrite>* log)
+{
+    writeLog_ = log;
+    for (int page = 0; page < YB_PAGE_COUNT; ++page) {
+        mapPage(page);
+    }
+}
+
+uint8_t yb::MMU::peek8(uint16_t addr) const
+{
+    return memory_[addr >> YB_PAGE_SHIFT][addr & (YB_PAGE_SIZE - 1)];
+}
+
+void yb::MMU::peek(uint16_t addr, uint8_t* dst, size_t length) const
+{
+    while (length > 0) {
+        const size_t offset = addr & (YB_PAGE_SIZE - 1);
+        const size_t run = std::min(length, YB_PAGE_SIZE - offset);
+        std::memcpy(dst, memory_[addr >> YB_PAGE_SHIFT] + offset, run);
+
+        dst += run;
+        length -= run;
+        addr = (uint16_t)(addr + run);
+    }
+}
+
+void yb::MMU::store8(uint16_t addr, uint8_t value)
+{
+    const uint8_t page = addr >> YB_PAGE_SHIFT;
+    if (page != IO_PAGE) {
+        own(page);
+    }
+    memory_[page][addr & (YB_PAGE_SIZE - 1)] = value;
+}
+
+void yb::MMU::poke8(uint16_t addr, uint8_t value)
+{
+    if (displayListener_ && is_display_register(addr) && (io(STAT) & 0x03) == 0x03) {
+        displayListener_->onDisplayWrite(addr, value);
+    }
+
+    store8(addr, value);
+
+    if (displayListener_ && addr >= 0x8000 && addr < 0xA000) {
+        displayListener_->onVramWrite(cgb_ ? vramBank_ : 0, addr - 0x8000, 1);
+    }
+
+    if ((addr >> YB_PAGE_SHIFT) == (OAM >> YB_PAGE_SHIFT)) {
+        ++oamGeneration_;
+    }
+}
+
+uint8_t yb::MMU::bankAt(uint16_t addr) const
+{
+    // TODO: report the switchable bank once MBCs are supported
+    if (addr >= 0x4000 && addr < 0x8000) {
+        return 1;
+    }
+
+    return 0;
+}
+
+void yb::MMU::setJoypad(uint8_t buttons)
+{
+    const uint8_t pressed = buttons & ~joypad_;
+    joypad_ = buttons;
+
+    refreshJoypad();
+
+    if (pressed != 0) {
+        io(IF) |= 0x10;
+    }
+}
+
+uint8_t yb::MMU::joypad() const
+{
+    return joypad_;
+}
+
+// P1 reads back the lines of the selected button groups, active low.
+void yb::MMU::refreshJoypad()
+{
+    const uint8_t select = io(P1) & 0x30;
+
+    uint8_t lines = 0x0F;
+    if ((select & 0x10) == 0) {
+        lines &= ~(joypad_ & 0x0F);
+    }
+    if ((select & 0x20) == 0) {
+        lines &= ~(joypad_ >> 4);
+    }
+
+    io(P1) = 0xC0 | select | lines;
+}
+
+bool yb::MMU::isCGB() const
+{
+    return cgb_;
+}
+
+uint8_t yb::MMU::speedShift() const
+{
+    return doubleSpeed_ ? 1 : 0;
+}
+
+bool yb::MMU::switchSpeed()
+{
+    if (!cgb_ || (io(KEY1) & 0x01) == 0) {
+        return false;
+    }
+
+    doubleSpeed_ = !doubleSpeed_;
+    io(KEY1) = (doubleSpeed_ ? 0x80 : 0x00) | 0x7E;
+
+    return true;
+}
+
+void yb::MMU::hblank()
+{
+    if (hdmaBlocks_ == 0) {
+        return;
+    }
+
+    copy(hdmaSource_, hdmaDest_, HDMA_BLOCK);
+
+    --hdmaBlocks_;
+    io(HDMA5) = hdmaBlocks_ > 0 ? hdmaBlocks_ - 1 : 0xFF;
+}
+
+uint32_t yb::MMU::oamGeneration() const
+{
+    return oamGeneration_;
+}
+
+const uint8_t* yb::MMU::vram(uint8_t bank) const
+{
+    return contents(vram_[bank & 0x01], ZEROES);
+}
+
+const uint8_t* yb::MMU::bgPalettes() const
+{
+    return bgPalettes_;
+}
+
+const uint8_t* yb::MMU::objPalettes() const
+{
+    return objPalettes_;
+}
+
+void yb::MMU::setCartridgeRam(uint8_t* ram, size_t size)
+{
+    cartRam_ = ram;
+    cartRamPages_ = std::min(size / YB_PAGE_SIZE, (size_t) CART_RAM_PAGES);
+    for (int page = CART_RAM_PAGE; page < CART_RAM_PAGE + CART_RAM_PAGES; ++page) {
+        locate(page);
+    }
+}
+
+uint8_t* yb::MMU::cartridgeRam() const
+{
+    return cartRam_;
+}
+
+size_t yb::MMU::cartridgeRamSize() const
+{
+    return cartRamPages_ * YB_PAGE_SIZE;
+}
+
+void yb::MMU::setClock(const uint64_t* cycles)
+{
+    clock_ = cycles;
+}
+
+const std::string& yb::MMU::serial() const
+{
+    return serial_;
+}
+
+// The state keeps the layout of a flat 64KB address space, with ROM and
+// cartridge RAM where they appear in it and zeros behind VRAM and WRAM,
+// followed by all of VRAM and WRAM.
+void yb::MMU::save(yb::StateWriter& writer) const
+{
+    for (size_t page = 0; page < IO_PAGE; ++page) {
+        const bool external = page >= CART_RAM_PAGE && page < CART_RAM_PAGE + cartRamPages_;
+        writer.writeBytes(external ? memory_[page] : contents(pages_[page], initial(page)), YB_PAGE_SIZE);
+    }
+    writer.writeBytes(io_, sizeof(io_));
+    for (const yb::SharedBlock& bank : vram_) {
+        writer.writeBytes(contents(bank, ZEROES), YB_VRAM_BANK_SIZE);
+    }
+    for (const yb::SharedBlock& page : wram_) {
+        writer.writeBytes(contents(page, ZEROES), YB_PAGE_SIZE);
+    }
+    writer.write8(joypad_);
+
+    writer.write8(vramBank_);
+    writer.write8(wramBank_);
+    writer.write8(doubleSpeed_);
+    writer.writeBytes(bgPalettes_, sizeof(bgPalettes_));
+    writer.writeBytes(objPalettes_, sizeof(objPalettes_));
+    writer.write16(hdmaSource_);
+    writer.write16(hdmaDest_);
+    writer.write8(hdmaBlocks_);
+    writer.write64(dmaEnd_);
+
+    writer.write32(serial_.size());
+    writer.writeBytes(serial_.data(), serial_.size());
+}
+
+// Blocks keep what they hold, still shared if they are, where the state
+// agrees with it, so loading leaves ROM that wasn't patched with the
+// cartridge and untouched memory unbacked.
+void yb::MMU::loadBlock(yb::StateReader& reader, yb::SharedBlock& block, const uint8_t* initial, size_t size)
+{
+    uint8_t bytes[YB_VRAM_BANK_SIZE];
+    reader.readBytes(bytes, size);
+
+    if (std::memcmp(bytes, contents(block, initial), size) != 0) {
+        block.assign(bytes, size);
+    }
+}
+
+void yb::MMU::load(yb::StateReader& reader)
+{
+    for (size_t page = 0; page < IO_PAGE; ++page) {
+        if (page >= CART_RAM_PAGE && page < CART_RAM_PAGE + cartRamPages_) {
+            reader.readBytes(memory_[page], YB_PAGE_SIZE);
+        } else {
+            loadBlock(reader, pages_[page], initial(page), YB_PAGE_SIZE);
+        }
+    }
+    reader.readBytes(io_, sizeof(io_));
+    for (yb::SharedBlock& bank : vram_) {
+        loadBlock(reader, bank, ZEROES, YB_VRAM_BANK_SIZE);
+    }
+    for (yb::SharedBlock& page : wram_) {
+        loadBlock(reader, page, ZEROES, YB_PAGE_SIZE);
+    }
+    joypad_ = reader.read8();
+
+    vramBank_ = reader.read8() & 0x01;
+    wramBank_ = reader.read8() & 0x07;
+    if (wramBank_ == 0) {
+        wramBank_ = 1;
+    }
+    doubleSpeed_ = reader.read8() != 0;
+    reader.readBytes(bgPalettes_, sizeof(bgPalettes_));
+    reader.readBytes(objPalettes_, sizeof(objPalettes_));
+    hdmaSource_ = reader.read16();
+    hdmaDest_ = reader.read16();
+    hdmaBlocks_ = reader.read8();
+    ++oamGeneration_;
+    dmaEnd_ = reader.read64();
+    if (!clock_) {
+        dmaEnd_ = 0;
+    }
+    mapMemory();
+
+    const uint32_t serialSize = reader.read32();
+    if (serialSize > reader.remaining()) {
+        // a damaged length; don't allocate for it
+        reader.fail();
+        serial_.clear();
+        return;
+    }
+    serial_.resize(serialSize);
+    reader.readBytes(&serial_[0], serial_.size());
+}
+
+void yb::MMU::forkFrom(yb::MMU& parent)
+{
+    std::copy(parent.pages_, parent.pages_ + YB_PAGE_COUNT, pages_);
+    std::copy(parent.vram_, parent.vram_ + 2, vram_);
+    std::copy(parent.wram_, parent.wram_ + sizeof(wram_) / sizeof(wram_[0]), wram_);
+    std::memcpy(io_, parent.io_, sizeof(io_));
+
+    for (size_t i = 0; i < parent.cartRamPages_; ++i) {
+        pages_[CART_RAM_PAGE + i].assign(parent.memory_[CART_RAM_PAGE + i], YB_PAGE_SIZE);
+    }
+    cartRam_ = nullptr;
+    cartRamPages_ = 0;
+
+    joypad_ = parent.joypad_;
+    ++oamGeneration_;
+    dmaEnd_ = clock_ ? parent.dmaEnd_ : 0;
+    vramBank_ = parent.vramBank_;
+    wramBank_ = parent.wramBank_;
+    doubleSpeed_ = parent.doubleSpeed_;
+    std::memcpy(bgPalettes_, parent.bgPalettes_, sizeof(bgPalettes_));
+    std::memcpy(objPalettes_, parent.objPalettes_, sizeof(objPalettes_));
+    hdmaSource_ = parent.hdmaSource_;
+    hdmaDest_ = parent.hdmaDest_;
+    hdmaBlocks_ = parent.hdmaBlocks_;
+    serial_ = parent.serial_;
+
+    mapMemory();
+    // the parent's pages have to stop writing to what is now shared in place
+    for (int page = 0; page < YB_PAGE_COUNT; ++page) {
+        parent.mapPage(page);
+    }
+}
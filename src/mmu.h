@@ -1,24 +1,275 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
-#define YB_MEM_SIZE (0xFFFF)
+#include "savestate.h"
+
+#define YB_MEM_SIZE (0x10000)
+
+#define YB_PAGE_SHIFT (8)
+#define YB_PAGE_SIZE (1 << YB_PAGE_SHIFT)
+#define YB_PAGE_COUNT (YB_MEM_SIZE / YB_PAGE_SIZE)
+
+#define YB_VRAM_BANK_SIZE (0x2000)
+#define YB_WRAM_BANK_SIZE (0x1000)
 
 namespace yb {
 
+    enum Watch : uint8_t
+    {
+        WATCH_READ  = 1 << 0,
+        WATCH_WRITE = 1 << 1
+    };
+
+    // Told about CPU accesses to watched addresses: reads after the value is
+    // fetched, writes before they take effect.
+    class WatchListener
+    {
+    public:
+        virtual ~WatchListener() = default;
+
+        virtual void onWatch(uint16_t addr, uint8_t value, bool write) = 0;
+    };
+
+    // Told about what the PPU caches or draws from changing.
+    class DisplayListener
+    {
+    public:
+        virtual ~DisplayListener() = default;
+
+        // CPU writes to the PPU's registers (LCDC, scroll, window and DMG
+        // palettes) made during pixel transfer, before they take effect.
+        virtual void onDisplayWrite(uint16_t addr, uint8_t value) = 0;
+
+        // Writes to VRAM by the CPU or HDMA, after they're made. offset is
+        // relative to the start of the bank.
+        virtual void onVramWrite(uint8_t bank, uint16_t offset, uint16_t length) = 0;
+    };
+
+    struct MemoryWrite {
+        uint16_t addr;
+        uint8_t value;
+    };
+
+    // Memory an MMU shares with its forks until one of them writes to it. An
+    // unbacked block reads as what the MMU puts in its place (the cartridge
+    // or zeros) and only gets memory of its own on the first write.
+    class SharedBlock
+    {
+    public:
+        // Null while unbacked.
+        uint8_t* data() const;
+
+        // True while writes have to own() the block first: it's unbacked or
+        // another MMU holds its memory too.
+        bool isShared() const;
+
+        // If the block is shared, gives it memory of its own holding a copy of
+        // the size bytes at current. Returns true if data() changed.
+        bool own(const uint8_t* current, size_t size);
+
+        // Replaces the block's contents, giving it memory of its own if shared.
+        void assign(const uint8_t* bytes, size_t size);
+
+    private:
+        std::shared_ptr<uint8_t> data_;
+    };
+
+    // Memory is mapped through per-page read and write tables. A null entry
+    // sends accesses to that page down the slow path, which handles I/O
+    // registers, ROM writes and watchpoints; every other access is a single
+    // indexed load or store.
+    //
+    // While a display listener is set, VRAM writes take the slow path too so
+    // that it hears about them.
+    //
+    // OAM DMA copies all 160 bytes at once and unmaps every page for the 640
+    // cycles the real transfer holds the bus, during which the slow path only
+    // lets HRAM through. The first access after that maps the pages back.
+    //
+    // Switching a VRAM or WRAM bank on the CGB only repoints the pages of the
+    // banked range.
+    //
+    // Apart from the I/O page, memory is held in shared blocks: one per VRAM
+    // bank and one per page for the rest. ROM pages start out reading the
+    // cartridge image, which every machine running it shares, and the rest
+    // read zeros until written. A fork shares all of its parent's blocks and
+    // either side copies a block the first time it writes to it, so pages
+    // holding shared blocks write through the slow path.
     class MMU {
     public:
-        MMU(uint8_t* cartridge);
+        // A CGB MMU has two VRAM banks, eight WRAM banks, color palettes, HDMA
+        // and double speed; otherwise the CGB registers are plain memory.
+        // The first 32KB of cartridge are mapped as ROM and must outlive the MMU.
+        MMU(const uint8_t* cartridge, bool cgb = false);
 
-        uint8_t read8(uint16_t addr) const;
-        uint16_t read16(uint16_t addr) const;
+        // CPU accesses; reads may have side effects too (watchpoints, OAM DMA ending).
+        uint8_t read8(uint16_t addr);
+        uint16_t read16(uint16_t addr);
 
         void write8(uint16_t addr, uint8_t value);
         void write16(uint16_t addr, uint16_t value);
 
+        // Reads the backing memory without any of the side effects of a CPU read.
+        uint8_t peek8(uint16_t addr) const;
+        // Copies length bytes starting at addr, wrapping around at the end of
+        // the address space, one memcpy per contiguous run.
+        void peek(uint16_t addr, uint8_t* dst, size_t length) const;
+
+        // Stores a value without any of the side effects of a CPU write.
+        // Used by hardware components to update their own registers.
+        void store8(uint16_t addr, uint8_t value);
+
+        // Stores a value for a debugger. Skips the bus lock, watchpoints, the
+        // write log and register side effects, but tells the PPU about it like a
+        // CPU write would, so VRAM, OAM and display register edits show up.
+        void poke8(uint16_t addr, uint8_t value);
+
+        // Adds or removes watch flags (see yb::Watch) for an address.
+        // Only the pages holding watched addresses leave the fast path.
+        void watch(uint16_t addr, uint8_t flags);
+        void unwatch(uint16_t addr, uint8_t flags);
+
+        void setWatchListener(yb::WatchListener* listener);
+
+        void setDisplayListener(yb::DisplayListener* listener);
+
+        // Appends every CPU write to log until called with nullptr.
+        // While logging, writes to every page take the slow path.
+        void setWriteLog(std::vector<yb::MemoryWrite>* log);
+
+        // ROM bank mapped at the given address, 0 outside of ROM.
+        uint8_t bankAt(uint16_t addr) const;
+
+        // Sets the held buttons (see yb::Button) as seen through P1.
+        void setJoypad(uint8_t buttons);
+        uint8_t joypad() const;
+
+        bool isCGB() const;
+
+        // 1 in CGB double speed mode, where the CPU runs two cycles per PPU dot, 0 otherwise.
+        uint8_t speedShift() const;
+
+        // Performs the speed switch armed through KEY1, which is what STOP does
+        // on a CGB. Returns false if none was armed.
+        bool switchSpeed();
+
+        // Called by the PPU as each HBlank begins: copies the next block of a
+        // pending HBlank DMA.
+        void hblank();
+
+        // Changes whenever OAM may have: on CPU writes to it, OAM DMA and loading.
+        uint32_t oamGeneration() const;
+
+        // YB_VRAM_BANK_SIZE bytes of VRAM bank 0 or 1.
+        const uint8_t* vram(uint8_t bank) const;
+
+        // CGB palette memory: 8 palettes of 4 little endian RGB555 colors.
+        const uint8_t* bgPalettes() const;
+        const uint8_t* objPalettes() const;
+
+        // Backs cartridge RAM (0xA000-0xBFFF) with the first 8KB of ram, which
+        // must outlive the MMU, instead of the MMU's own memory. Pages past
+        // size stay with the MMU.
+        void setCartridgeRam(uint8_t* ram, size_t size);
+        // The memory given to setCartridgeRam, if any, and how much of it is used.
+        uint8_t* cartridgeRam() const;
+        size_t cartridgeRamSize() const;
+
+        // The CPU cycle counter, which times OAM DMA. Without one, OAM DMA
+        // copies without locking the bus.
+        void setClock(const uint64_t* cycles);
+
+        // Bytes sent over the serial port since power on.
+        const std::string& serial() const;
+
+        void save(yb::StateWriter& writer) const;
+        void load(yb::StateReader& reader);
+
+        // Turns this MMU, which must have been made for the same cartridge,
+        // into a copy of parent that shares its memory until one of them
+        // writes to it. Watches, listeners, the write log, the clock
+        // and external cartridge RAM aren't shared: the fork gets its own copy
+        // of the RAM's contents. Neither MMU may be in use by another thread.
+        void forkFrom(yb::MMU& parent);
+
     private:
-        uint8_t* cartridge_;
-        uint8_t ram_[YB_MEM_SIZE];
+        uint8_t readSlow(uint16_t addr);
+        void writeSlow(uint16_t addr, uint8_t value);
+
+        void startOamDma(uint8_t page);
+        bool isBusLocked(uint16_t addr);
+
+        uint8_t& io(uint16_t addr);
+
+        void mapPage(uint8_t page);
+        void mapBanks();
+        void mapMemory();
+        void locate(uint8_t page);
+
+        // The block behind page with the current banks, where the page starts
+        // in it and its size; null for I/O and external cartridge RAM.
+        yb::SharedBlock* blockAt(uint8_t page, size_t& offset, size_t& size);
+        // What page reads as while its own block is unbacked.
+        const uint8_t* initial(uint8_t page) const;
+        // Called before anything writes to page's memory without going
+        // through writePages_.
+        void own(uint8_t page);
+        void loadBlock(yb::StateReader& reader, yb::SharedBlock& block, const uint8_t* initial, size_t size);
+
+        void writeCGB(uint16_t addr, uint8_t value);
+        void writePalette(uint16_t spec, uint8_t* palettes, uint8_t value);
+        void copy(uint16_t src, uint16_t dst, size_t length);
+
+        void refreshJoypad();
+
+        const uint8_t* cartridge_;
+        // I/O registers and HRAM, which change all the time, so never shared
+        uint8_t io_[YB_PAGE_SIZE];
+        // pages with no bank switching, including the patched ROM pages; the
+        // ones behind VRAM and WRAM are never mapped
+        yb::SharedBlock pages_[YB_PAGE_COUNT];
+        yb::SharedBlock vram_[2];
+        yb::SharedBlock wram_[8 * YB_WRAM_BANK_SIZE / YB_PAGE_SIZE];
+        uint8_t* cartRam_;
+        size_t cartRamPages_;
+
+        // What every page is backed by with the current banks, whether or not
+        // accesses to it take the slow path.
+        uint8_t* memory_[YB_PAGE_COUNT];
+        const uint8_t* readPages_[YB_PAGE_COUNT];
+        uint8_t* writePages_[YB_PAGE_COUNT];
+
+        std::unordered_map<uint16_t, uint8_t> watches_;
+        uint8_t pageWatches_[YB_PAGE_COUNT];
+        yb::WatchListener* watchListener_;
+        yb::DisplayListener* displayListener_;
+        std::vector<yb::MemoryWrite>* writeLog_;
+
+        uint8_t joypad_;
+
+        uint32_t oamGeneration_;
+
+        const uint64_t* clock_;
+        // cycle at which the running OAM DMA frees the bus, 0 when idle
+        uint64_t dmaEnd_;
+
+        bool cgb_;
+        uint8_t vramBank_;
+        uint8_t wramBank_;
+        bool doubleSpeed_;
+        uint8_t bgPalettes_[64];
+        uint8_t objPalettes_[64];
+        uint16_t hdmaSource_;
+        uint16_t hdmaDest_;
+        // blocks of 16 bytes left to copy in HBlank mode, 0 when idle
+        uint8_t hdmaBlocks_;
+
+        std::string serial_;
     };
 
 }
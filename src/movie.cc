@@ -0,0 +1,225 @@
+#include "movie.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "common.h"
+#include "hash.h"
+#include "savestate.h"
+
+namespace yb {
+
+static constexpr char MAGIC[4] = { 'Y', 'B', 'M', 'V' };
+static constexpr uint16_t VERSION = 1;
+
+static void write_varint(yb::StateWriter& writer, uint64_t value)
+{
+    while (value >= 0x80) {
+        writer.write8((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    writer.write8((uint8_t) value);
+}
+
+static uint64_t read_varint(yb::StateReader& reader)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && reader.ok(); shift += 7) {
+        const uint8_t byte = reader.read8();
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+
+    return value;
+}
+
+} // end namespace
+
+yb::Movie::Movie()
+    : romHash_(0)
+    , finalHash_(0)
+{}
+
+void yb::Movie::append(uint8_t buttons)
+{
+    buttons_.push_back(buttons);
+}
+
+size_t yb::Movie::frames() const
+{
+    return buttons_.size();
+}
+
+uint8_t yb::Movie::buttonsAt(size_t frame) const
+{
+    return frame < buttons_.size() ? buttons_[frame] : 0;
+}
+
+uint64_t yb::Movie::romHash() const
+{
+    return romHash_;
+}
+
+void yb::Movie::setRomHash(uint64_t hash)
+{
+    romHash_ = hash;
+}
+
+uint64_t yb::Movie::finalHash() const
+{
+    return finalHash_;
+}
+
+void yb::Movie::setFinalHash(uint64_t hash)
+{
+    finalHash_ = hash;
+}
+
+bool yb::Movie::save(const char* path) const
+{
+    std::vector<uint8_t> data;
+    yb::StateWriter writer(data);
+    writer.writeBytes(MAGIC, sizeof(MAGIC));
+    writer.write16(VERSION);
+    writer.write64(romHash_);
+    writer.write64(finalHash_);
+    writer.write32((uint32_t) buttons_.size());
+
+    for (size_t frame = 0; frame < buttons_.size();) {
+        size_t run = 1;
+        while (frame + run < buttons_.size() && buttons_[frame + run] == buttons_[frame]) {
+            ++run;
+        }
+
+        writer.write8(buttons_[frame]);
+        write_varint(writer, run);
+        frame += run;
+    }
+
+    std::FILE* file = std::fopen(path, "wb");
+    if (!file) {
+        yb::error("Could not write %s.\n", path);
+        return false;
+    }
+
+    const bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (std::fclose(file) != 0 || !written) {
+        yb::error("Could not write %s.\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool yb::Movie::load(const char* path)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        yb::error("Could not read %s.\n", path);
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n = 0;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    std::fclose(file);
+
+    yb::StateReader reader(data.data(), data.size());
+    char magic[sizeof(MAGIC)];
+    reader.readBytes(magic, sizeof(magic));
+    const uint16_t version = reader.read16();
+    romHash_ = reader.read64();
+    finalHash_ = reader.read64();
+    const uint32_t frames = reader.read32();
+
+    if (!reader.ok() || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        yb::error("%s is not a movie.\n", path);
+        return false;
+    }
+    if (version != VERSION) {
+        yb::error("%s is a version %u movie; only version %u is supported.\n", path, version, VERSION);
+        return false;
+    }
+
+    buttons_.clear();
+    while (buttons_.size() < frames && reader.ok()) {
+        const uint8_t buttons = reader.read8();
+        const uint64_t run = read_varint(reader);
+        if (run == 0 || run > frames - buttons_.size()) {
+            break;
+        }
+        buttons_.insert(buttons_.end(), (size_t) run, buttons);
+    }
+
+    if (!reader.ok() || buttons_.size() != frames) {
+        yb::error("%s is damaged.\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+yb::MovieRecorder::MovieRecorder(yb::Emulator* emulator, yb::Movie* movie)
+    : emulator_(emulator)
+    , movie_(movie)
+{
+    emulator_->addFrameHook(this);
+}
+
+yb::MovieRecorder::~MovieRecorder()
+{
+    emulator_->removeFrameHook(this);
+}
+
+void yb::MovieRecorder::onFrame()
+{
+    movie_->append(emulator_->input());
+}
+
+uint64_t yb::rom_hash(const yb::Cartridge& cartridge)
+{
+    return yb::hash64(cartridge.data(), cartridge.size());
+}
+
+uint64_t yb::state_hash(const yb::Emulator& emulator)
+{
+    std::vector<uint8_t> state;
+    emulator.saveState(state);
+
+    return yb::hash64(state.data(), state.size());
+}
+
+int yb::play_movie(yb::Emulator& emulator, const yb::Movie& movie)
+{
+    if (movie.romHash() != rom_hash(emulator.cartridge())) {
+        yb::error("The movie was recorded on a different ROM.\n");
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < movie.frames(); ++frame) {
+        emulator.setInput(movie.buttonsAt(frame));
+        emulator.runFrame();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::printf("Replayed %zu frames in %.3f s (%.0f frames/s).\n",
+        movie.frames(), elapsed.count(), elapsed.count() > 0 ? movie.frames() / elapsed.count() : 0.0);
+    std::fflush(stdout);
+
+    const uint64_t hash = state_hash(emulator);
+    if (hash != movie.finalHash()) {
+        yb::error("The final state differs: expected %016" PRIx64 ", got %016" PRIx64 ".\n", movie.finalHash(), hash);
+        return 1;
+    }
+
+    std::puts("The final state matches the recording.");
+    return 0;
+}
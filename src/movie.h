@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "emulator.h"
+#include "hook.h"
+
+namespace yb {
+
+    // Joypad input for every frame since power on, together with hashes of the
+    // ROM it was recorded on and of the machine state it ended in.
+    //
+    // On disk the buttons (one bit each, see yb::Button) are run-length encoded:
+    // a button byte followed by the number of frames it was held for as an
+    // unsigned LEB128 varint.
+    class Movie
+    {
+    public:
+        Movie();
+
+        void append(uint8_t buttons);
+
+        size_t frames() const;
+        uint8_t buttonsAt(size_t frame) const;
+
+        uint64_t romHash() const;
+        void setRomHash(uint64_t hash);
+
+        uint64_t finalHash() const;
+        void setFinalHash(uint64_t hash);
+
+        bool save(const char* path) const;
+        bool load(const char* path);
+
+    private:
+        std::vector<uint8_t> buttons_;
+        uint64_t romHash_;
+        uint64_t finalHash_;
+    };
+
+    // Appends the buttons every emulated frame ran with to a movie.
+    class MovieRecorder : public yb::FrameHook
+    {
+    public:
+        // Neither is owned; the recorder installs itself on the emulator.
+        MovieRecorder(yb::Emulator* emulator, yb::Movie* movie);
+        ~MovieRecorder();
+
+        void onFrame() override;
+
+    private:
+        MovieRecorder(const MovieRecorder&) = delete;
+        MovieRecorder& operator=(const MovieRecorder&) = delete;
+
+        yb::Emulator* emulator_;
+        yb::Movie* movie_;
+    };
+
+    uint64_t rom_hash(const yb::Cartridge& cartridge);
+
+    // Hash of everything a save state holds.
+    uint64_t state_hash(const yb::Emulator& emulator);
+
+    // Replays the movie headlessly as fast as possible from power on, reports
+    // the speed and checks that the run ends in the recorded state.
+    // Returns 0 if it does, 1 otherwise.
+    int play_movie(yb::Emulator& emulator, const yb::Movie& movie);
+
+}
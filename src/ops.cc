@@ -67,7 +67,7 @@ std::unordered_map<uint8_t, yb::Instruction> yb::INSTRUCTIONS = {
 	{ 0XD , Instruction{ 0XD, "DEC C", 1, 4 } },
 	{ 0XE , Instruction{ 0XE, "LD C,BYTE", 2, 8 } },
 	{ 0XF , Instruction{ 0XF, "RRCA ", 1, 4 } },
-	{ 0X10 , Instruction{ 0X10, "STOP 0", 1, 4 } },
+	{ 0X10 , Instruction{ 0X10, "STOP 0", 2, 4 } },
 	{ 0X11 , Instruction{ 0X11, "LD DE,WORD", 3, 12 } },
 	{ 0X12 , Instruction{ 0X12, "LD (DE),A", 1, 8 } },
 	{ 0X13 , Instruction{ 0X13, "INC DE", 1, 8 } },
@@ -0,0 +1,747 @@
+#include "ppu.h"
+
+#include <algorithm>
+
+namespace yb {
+
+static constexpr uint16_t LCDC = 0xFF40;
+static constexpr uint16_t STAT = 0xFF41;
+static constexpr uint16_t SCY  = 0xFF42;
+static constexpr uint16_t SCX  = 0xFF43;
+static constexpr uint16_t LY   = 0xFF44;
+static constexpr uint16_t LYC  = 0xFF45;
+static constexpr uint16_t BGP  = 0xFF47;
+static constexpr uint16_t OBP0 = 0xFF48;
+static constexpr uint16_t OBP1 = 0xFF49;
+static constexpr uint16_t WY   = 0xFF4A;
+static constexpr uint16_t WX   = 0xFF4B;
+static constexpr uint16_t IF   = 0xFF0F;
+
+static constexpr uint16_t OAM_SEARCH_DOTS = 80;
+static constexpr uint16_t TRANSFER_DOTS = 172;
+static constexpr uint16_t HBLANK_DOTS = 204;
+static constexpr uint16_t LINE_DOTS = OAM_SEARCH_DOTS + TRANSFER_DOTS + HBLANK_DOTS;
+
+static constexpr uint8_t VBLANK_LINE = 144;
+static constexpr uint8_t LAST_LINE = 153;
+
+static constexpr uint16_t OAM = 0xFE00;
+static constexpr int SPRITE_COUNT = 40;
+static constexpr uint8_t MAX_LINE_SPRITES = 10;
+
+// OAM attribute flags
+static constexpr uint8_t BEHIND_BG = 0x80;
+static constexpr uint8_t FLIP_Y = 0x40;
+static constexpr uint8_t FLIP_X = 0x20;
+static constexpr uint8_t DMG_PALETTE = 0x10;
+static constexpr uint8_t CGB_BANK = 0x08;
+
+// Set in the background buffer where a CGB tile attribute takes priority over sprites.
+static constexpr uint8_t BG_PRIORITY = 0x80;
+
+static constexpr uint32_t SHADES[4] = { 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000 };
+
+// Returns the 2 bit color index of pixel x of a tile row's two bit planes.
+static uint8_t row_pixel(uint8_t lo, uint8_t hi, uint8_t x)
+{
+    const uint8_t bit = 7 - x;
+
+    return ((hi >> bit) & 1) << 1 | ((lo >> bit) & 1);
+}
+
+// Every RGB555 color converted once, each channel stretched from 5 to 8 bits.
+struct ColorTable {
+    uint32_t argb[0x8000];
+
+    ColorTable()
+    {
+        for (uint32_t color = 0; color < 0x8000; ++color) {
+            const uint32_t r = color & 0x1F;
+            const uint32_t g = (color >> 5) & 0x1F;
+            const uint32_t b = (color >> 10) & 0x1F;
+
+            argb[color] = 0xFF000000 | (r << 3 | r >> 2) << 16 | (g << 3 | g >> 2) << 8 | (b << 3 | b >> 2);
+        }
+    }
+};
+
+static const uint32_t* color_table()
+{
+    static const ColorTable table;
+    return table.argb;
+}
+
+// Resolves a tile map entry to the address of its tile data according to LCDC bit 4.
+static uint16_t tile_address(uint8_t lcdc, uint8_t index)
+{
+    if (lcdc & 0x10) {
+        return 0x8000 + index * 16;
+    }
+
+    return 0x9000 + (int8_t)index * 16;
+}
+
+// Whether a sprite pixel shows over a background pixel: it does unless it
+// was placed behind the background, or a CGB tile attribute put the tile in
+// front, and the background's color isn't 0. Without bgPriority, which a CGB
+// drops when LCDC bit 0 is clear, sprites are always in front.
+static bool sprite_shows(uint8_t background, uint8_t flags, bool bgPriority)
+{
+    const bool behind = (flags & BEHIND_BG) || (background & BG_PRIORITY);
+
+    return !(bgPriority && behind && (background & 0x03) != 0);
+}
+
+} // end namespace
+
+bool yb::parse_ppu_engine(const std::string& name, yb::PPUEngine& engine)
+{
+    static const struct {
+        const char* name;
+        yb::PPUEngine engine;
+    } ENGINES[] = {
+        { "scanline", yb::PPUEngine::SCANLINE },
+        { "fifo", yb::PPUEngine::FIFO },
+        { "auto", yb::PPUEngine::AUTO },
+    };
+
+    for (const auto& entry : ENGINES) {
+        if (name == entry.name) {
+            engine = entry.engine;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+yb::PPU::PPU(yb::MMU* mmu)
+    : mmu_(mmu)
+    , engine_(PPUEngine::AUTO)
+    , colors_(mmu->isCGB() ? color_table() : nullptr)
+    , mode_(PPUMode::OAM_SEARCH)
+    , dots_(0)
+    , ly_(0)
+    , windowLine_(0)
+    , spriteGeneration_(0)
+    , spriteHeight_(0)
+    , vramVersion_(1)
+    , fifoActive_(false)
+{
+    std::fill(framebuffer_, framebuffer_ + YB_SCREEN_WIDTH * YB_SCREEN_HEIGHT, SHADES[0]);
+    std::fill(dirtyLines_, dirtyLines_ + YB_SCREEN_HEIGHT, true);
+    std::fill(tileVersions_, tileVersions_ + 2 * 384, 1);
+
+    mmu_->setDisplayListener(this);
+}
+
+yb::PPU::~PPU()
+{
+    mmu_->setDisplayListener(nullptr);
+}
+
+void yb::PPU::setEngine(yb::PPUEngine engine)
+{
+    engine_ = engine;
+}
+
+yb::PPUEngine yb::PPU::engine() const
+{
+    return engine_;
+}
+
+bool yb::PPU::step(uint8_t cycles)
+{
+    bool frameDone = false;
+
+    dots_ += cycles;
+    for (;;) {
+        switch (mode_) {
+        case PPUMode::OAM_SEARCH:
+            if (dots_ < OAM_SEARCH_DOTS) {
+                return frameDone;
+            }
+            dots_ -= OAM_SEARCH_DOTS;
+            setMode(PPUMode::TRANSFER);
+            if (engine_ == PPUEngine::FIFO) {
+                startFifo();
+            }
+            break;
+        case PPUMode::TRANSFER:
+            if (fifoActive_) {
+                runFifo(std::min(dots_, TRANSFER_DOTS));
+            }
+            if (dots_ < TRANSFER_DOTS) {
+                return frameDone;
+            }
+            dots_ -= TRANSFER_DOTS;
+            if (fifoActive_) {
+                finishFifo();
+            } else {
+                renderLine();
+            }
+            setMode(PPUMode::HBLANK);
+            mmu_->hblank();
+            break;
+        case PPUMode::HBLANK:
+            if (dots_ < HBLANK_DOTS) {
+                return frameDone;
+            }
+            dots_ -= HBLANK_DOTS;
+            setLY(ly_ + 1);
+            if (ly_ == VBLANK_LINE) {
+                setMode(PPUMode::VBLANK);
+                mmu_->store8(IF, mmu_->peek8(IF) | 0x01);
+                frameDone = true;
+            } else {
+                setMode(PPUMode::OAM_SEARCH);
+            }
+            break;
+        case PPUMode::VBLANK:
+            if (dots_ < LINE_DOTS) {
+                return frameDone;
+            }
+            dots_ -= LINE_DOTS;
+            if (ly_ == LAST_LINE) {
+                setLY(0);
+                windowLine_ = 0;
+                setMode(PPUMode::OAM_SEARCH);
+            } else {
+                setLY(ly_ + 1);
+            }
+            break;
+        }
+    }
+}
+
+const uint32_t* yb::PPU::framebuffer() const
+{
+    return framebuffer_;
+}
+
+const bool* yb::PPU::dirtyLines() const
+{
+    return dirtyLines_;
+}
+
+void yb::PPU::clearDirtyLines()
+{
+    std::fill(dirtyLines_, dirtyLines_ + YB_SCREEN_HEIGHT, false);
+}
+
+void yb::PPU::save(yb::StateWriter& writer) const
+{
+    writer.write8((uint8_t) mode_);
+    writer.write16(dots_);
+    writer.write8(ly_);
+    writer.write8(windowLine_);
+}
+
+void yb::PPU::load(yb::StateReader& reader)
+{
+    mode_ = (PPUMode) reader.read8();
+    dots_ = reader.read16();
+    ly_ = reader.read8();
+    windowLine_ = reader.read8();
+
+    spriteHeight_ = 0;
+    fifoActive_ = false;
+    for (TileLayer& layer : layers_) {
+        std::fill(layer.drawn, layer.drawn + 32 * 32, 0);
+    }
+    ++vramVersion_;
+}
+
+void yb::PPU::setMode(PPUMode mode)
+{
+    mode_ = mode;
+
+    const uint8_t stat = mmu_->peek8(STAT);
+    mmu_->store8(STAT, (stat & ~0x03) | (uint8_t) mode);
+}
+
+void yb::PPU::setLY(uint8_t ly)
+{
+    ly_ = ly;
+    mmu_->store8(LY, ly);
+
+    // LY=LYC coincidence flag
+    const uint8_t stat = mmu_->peek8(STAT);
+    if (ly == mmu_->peek8(LYC)) {
+        mmu_->store8(STAT, stat | 0x04);
+    } else {
+        mmu_->store8(STAT, stat & ~0x04);
+    }
+}
+
+// Draws the current line off to the side and only lets it into the framebuffer,
+// marking it dirty, if it differs from what the previous frame left there.
+// The FIFO presents its lines the same way.
+void yb::PPU::renderLine()
+{
+    uint32_t line[YB_SCREEN_WIDTH];
+    // background color index of every pixel, for sprites to hide behind
+    uint8_t background[YB_SCREEN_WIDTH];
+    drawLine(line, background);
+
+    // LCD and sprites on
+    const uint8_t lcdc = mmu_->peek8(LCDC);
+    if ((lcdc & 0x82) == 0x82) {
+        drawSprites(line, background, lcdc);
+    }
+
+    presentLine(line);
+}
+
+void yb::PPU::presentLine(const uint32_t* line)
+{
+    uint32_t* row = framebuffer_ + ly_ * YB_SCREEN_WIDTH;
+    if (!std::equal(line, line + YB_SCREEN_WIDTH, row)) {
+        std::copy(line, line + YB_SCREEN_WIDTH, row);
+        dirtyLines_[ly_] = true;
+    }
+}
+
+void yb::PPU::drawLine(uint32_t* line, uint8_t* background)
+{
+    const uint8_t lcdc = mmu_->peek8(LCDC);
+    // LCD off, or the background disabled on a DMG; a CGB still draws it
+    if ((lcdc & 0x80) == 0 || (!colors_ && (lcdc & 0x01) == 0)) {
+        std::fill(line, line + YB_SCREEN_WIDTH, SHADES[0]);
+        std::fill(background, background + YB_SCREEN_WIDTH, 0);
+        return;
+    }
+
+    const uint8_t scx = mmu_->peek8(SCX);
+    const uint8_t scy = mmu_->peek8(SCY);
+
+    const uint8_t wy = mmu_->peek8(WY);
+    const int wx = mmu_->peek8(WX) - 7;
+    const bool windowVisible = (lcdc & 0x20) && ly_ >= wy && wx < YB_SCREEN_WIDTH;
+    // where the window takes over
+    const int split = windowVisible ? std::max(wx, 0) : YB_SCREEN_WIDTH;
+
+    // the background wraps around the right edge of its layer
+    const uint8_t* row = layerRow(lcdc, 0x08, ly_ + scy);
+    const int right = std::min(split, 256 - scx);
+    std::copy(row + scx, row + scx + right, background);
+    std::copy(row, row + split - right, background + right);
+
+    if (windowVisible) {
+        const uint8_t* window = layerRow(lcdc, 0x40, windowLine_) + (split - wx);
+        std::copy(window, window + YB_SCREEN_WIDTH - split, background + split);
+        ++windowLine_;
+    }
+
+    // every palette's colors, indexed by the low 5 bits of a pixel
+    uint32_t colors[32];
+    const uint8_t paletteCount = colors_ ? 8 : 1;
+    for (uint8_t pixel = 0; pixel < paletteCount * 4; ++pixel) {
+        colors[pixel] = backgroundColor(pixel);
+    }
+
+    for (int x = 0; x < YB_SCREEN_WIDTH; ++x) {
+        line[x] = colors[background[x] & 0x1F];
+    }
+}
+
+yb::PPU::TileLayer::TileLayer()
+{
+    std::fill(drawn, drawn + 32 * 32, 0);
+    std::fill(checked, checked + 32, 0);
+}
+
+void yb::PPU::onVramWrite(uint8_t bank, uint16_t offset, uint16_t length)
+{
+    const uint16_t end = offset + length;
+
+    // tile data
+    if (offset < 0x1800) {
+        const uint16_t first = bank * 384 + offset / 16;
+        const uint16_t last = bank * 384 + (std::min(end, (uint16_t) 0x1800) - 1) / 16;
+        for (uint16_t tile = first; tile <= last; ++tile) {
+            ++tileVersions_[tile];
+        }
+    }
+
+    // either map, whose attributes are at the same offsets in bank 1
+    for (uint16_t map = 0; map < 2; ++map) {
+        const uint16_t start = 0x1800 + map * 0x400;
+        const uint16_t first = std::max(offset, start);
+        const uint16_t last = std::min(end, (uint16_t)(start + 0x400));
+        if (first >= last) {
+            continue;
+        }
+
+        for (uint8_t tiles = 0; tiles < 2; ++tiles) {
+            TileLayer& layer = layers_[map * 2 + tiles];
+            std::fill(layer.drawn + (first - start), layer.drawn + (last - start), 0);
+        }
+    }
+
+    ++vramVersion_;
+}
+
+// Line y of the layer of the map LCDC's mapBit (0x08 for the background,
+// 0x40 for the window) selects, as seen through the tile data area it
+// selects. The map row holding the line is brought up to date first.
+const uint8_t* yb::PPU::layerRow(uint8_t lcdc, uint8_t mapBit, uint8_t y)
+{
+    const bool highMap = lcdc & mapBit;
+    const bool unsignedTiles = lcdc & 0x10;
+
+    TileLayer& layer = layers_[highMap * 2 + unsignedTiles];
+    // most games only ever draw through one or two of the four
+    if (layer.pixels.empty()) {
+        layer.pixels.resize(256 * 256);
+    }
+    uint8_t* pixels = layer.pixels.data() + y * 256;
+
+    const uint8_t mapRow = y / 8;
+    if (layer.checked[mapRow] == vramVersion_) {
+        return pixels;
+    }
+    layer.checked[mapRow] = vramVersion_;
+
+    const uint16_t map = (highMap ? 0x1C00 : 0x1800) + mapRow * 32;
+    const uint8_t* indices = mmu_->vram(0) + map;
+    const uint8_t* attributes = mmu_->vram(1) + map;
+
+    for (uint8_t column = 0; column < 32; ++column) {
+        const uint8_t index = indices[column];
+        const uint8_t attribute = colors_ ? attributes[column] : 0;
+        const uint8_t bank = (attribute & 0x08) ? 1 : 0;
+
+        const uint16_t tile = unsignedTiles ? index : 256 + (int8_t) index;
+        const uint32_t version = tileVersions_[bank * 384 + tile];
+        uint32_t& drawn = layer.drawn[mapRow * 32 + column];
+        if (drawn == version) {
+            continue;
+        }
+        drawn = version;
+
+        const uint8_t* data = mmu_->vram(bank) + tile * 16;
+        const uint8_t extra = (attribute & 0x07) << 2 | (attribute & BG_PRIORITY);
+        uint8_t* block = layer.pixels.data() + mapRow * 8 * 256 + column * 8;
+        for (uint8_t ty = 0; ty < 8; ++ty) {
+            const uint8_t row = (attribute & 0x40) ? 7 - ty : ty;
+            const uint8_t lo = data[row * 2];
+            const uint8_t hi = data[row * 2 + 1];
+
+            for (uint8_t tx = 0; tx < 8; ++tx) {
+                block[ty * 256 + tx] = row_pixel(lo, hi, (attribute & 0x20) ? 7 - tx : tx) | extra;
+            }
+        }
+    }
+
+    return pixels;
+}
+
+// Buckets the sprites by the lines they cover. Each line keeps the first 10
+// in OAM order, which are the ones the hardware selects. On a DMG the
+// sprite with the smaller X then wins, ties going to the earlier one; on a
+// CGB OAM order alone decides.
+void yb::PPU::buildSpriteLines(uint8_t height)
+{
+    mmu_->peek(OAM, oam_, sizeof(oam_));
+
+    for (SpriteLine& line : spriteLines_) {
+        line.count = 0;
+    }
+
+    for (int sprite = 0; sprite < SPRITE_COUNT; ++sprite) {
+        const int top = oam_[sprite * 4] - 16;
+        const int bottom = std::min(top + height, (int) YB_SCREEN_HEIGHT);
+
+        for (int y = std::max(top, 0); y < bottom; ++y) {
+            SpriteLine& line = spriteLines_[y];
+            if (line.count < MAX_LINE_SPRITES) {
+                line.sprites[line.count++] = sprite;
+            }
+        }
+    }
+
+    if (!colors_) {
+        for (SpriteLine& line : spriteLines_) {
+            std::stable_sort(line.sprites, line.sprites + line.count, [this](uint8_t a, uint8_t b) {
+                return oam_[a * 4 + 1] < oam_[b * 4 + 1];
+            });
+        }
+    }
+
+    spriteGeneration_ = mmu_->oamGeneration();
+    spriteHeight_ = height;
+}
+
+// The first sprite in priority order with an opaque pixel owns it. Fills in
+// the color and flags of each x's owner, color 0 where there is none, and
+// returns false if no sprite is on the line.
+bool yb::PPU::fetchSprites(uint8_t lcdc, uint8_t* colors, uint8_t* flags)
+{
+    const uint8_t height = (lcdc & 0x04) ? 16 : 8;
+    if (spriteGeneration_ != mmu_->oamGeneration() || spriteHeight_ != height) {
+        buildSpriteLines(height);
+    }
+
+    const SpriteLine& sprites = spriteLines_[ly_];
+    if (sprites.count == 0) {
+        return false;
+    }
+
+    std::fill(colors, colors + YB_SCREEN_WIDTH, 0);
+    for (uint8_t i = 0; i < sprites.count; ++i) {
+        const uint8_t* sprite = oam_ + sprites.sprites[i] * 4;
+        const uint8_t attributes = sprite[3];
+
+        int row = ly_ - (sprite[0] - 16);
+        if (attributes & FLIP_Y) {
+            row = height - 1 - row;
+        }
+
+        // the tile index of 8x16 sprites ignores bit 0
+        const uint8_t tile = height == 16 ? sprite[2] & 0xFE : sprite[2];
+        const uint8_t bank = colors_ && (attributes & CGB_BANK) ? 1 : 0;
+        const uint8_t* data = mmu_->vram(bank) + tile * 16 + row * 2;
+
+        const int left = sprite[1] - 8;
+        for (int px = 0; px < 8; ++px) {
+            const int x = left + px;
+            if (x < 0 || x >= YB_SCREEN_WIDTH || colors[x] != 0) {
+                continue;
+            }
+
+            colors[x] = row_pixel(data[0], data[1], (attributes & FLIP_X) ? 7 - px : px);
+            flags[x] = attributes;
+        }
+    }
+
+    return true;
+}
+
+// A sprite's pixel either shows or, behind the background, leaves it to the
+// background's colors 1-3.
+void yb::PPU::drawSprites(uint32_t* line, const uint8_t* background, uint8_t lcdc)
+{
+    uint8_t colors[YB_SCREEN_WIDTH];
+    uint8_t flags[YB_SCREEN_WIDTH];
+    if (!fetchSprites(lcdc, colors, flags)) {
+        return;
+    }
+
+    // on a CGB, clearing LCDC bit 0 puts every sprite above the background
+    const bool bgPriority = !colors_ || (lcdc & 0x01);
+
+    for (int x = 0; x < YB_SCREEN_WIDTH; ++x) {
+        if (colors[x] != 0 && sprite_shows(background[x], flags[x], bgPriority)) {
+            line[x] = spriteColor(colors[x], flags[x]);
+        }
+    }
+}
+
+uint32_t yb::PPU::backgroundColor(uint8_t pixel) const
+{
+    const uint8_t color = pixel & 0x03;
+    if (colors_) {
+        const uint8_t* rgb = mmu_->bgPalettes() + ((pixel >> 2) & 0x07) * 8 + color * 2;
+        return colors_[(rgb[1] & 0x7F) << 8 | rgb[0]];
+    }
+
+    return SHADES[(mmu_->peek8(BGP) >> (color * 2)) & 0x03];
+}
+
+uint32_t yb::PPU::spriteColor(uint8_t color, uint8_t flags) const
+{
+    if (colors_) {
+        const uint8_t* rgb = mmu_->objPalettes() + (flags & 0x07) * 8 + color * 2;
+        return colors_[(rgb[1] & 0x7F) << 8 | rgb[0]];
+    }
+
+    const uint8_t obp = mmu_->peek8((flags & DMG_PALETTE) ? OBP1 : OBP0);
+    return SHADES[(obp >> (color * 2)) & 0x03];
+}
+
+// Catches the FIFO up to the write before it lands. Under AUTO the first such
+// write of a line starts the FIFO and replays the transfer so far, which saw
+// the registers as they still are.
+void yb::PPU::onDisplayWrite(uint16_t, uint8_t)
+{
+    if (mode_ != PPUMode::TRANSFER || engine_ == PPUEngine::SCANLINE) {
+        return;
+    }
+
+    if (!fifoActive_) {
+        startFifo();
+    }
+    runFifo(dots_);
+}
+
+// Sprites are fetched for the whole line up front, as OAM search has already
+// picked them; their palettes and whether they show are decided per pixel.
+void yb::PPU::startFifo()
+{
+    fifoActive_ = true;
+    fifoDots_ = 0;
+    fifoX_ = 0;
+    fifoDiscard_ = mmu_->peek8(SCX) % 8;
+    fifoHead_ = 8;
+    fetchStep_ = 0;
+    fetchX_ = 0;
+    fetchWindow_ = false;
+    windowUsed_ = false;
+
+    if (!fetchSprites(mmu_->peek8(LCDC), spriteColors_, spriteFlags_)) {
+        std::fill(spriteColors_, spriteColors_ + YB_SCREEN_WIDTH, 0);
+    }
+}
+
+void yb::PPU::runFifo(uint16_t dots)
+{
+    while (fifoDots_ < dots && fifoX_ < YB_SCREEN_WIDTH) {
+        tickFifo();
+        ++fifoDots_;
+    }
+}
+
+void yb::PPU::finishFifo()
+{
+    while (fifoX_ < YB_SCREEN_WIDTH) {
+        tickFifo();
+    }
+
+    if (windowUsed_) {
+        ++windowLine_;
+    }
+
+    presentLine(fifoLine_);
+    fifoActive_ = false;
+}
+
+// One dot: the fetcher takes its next step, then the shifter outputs a pixel
+// if it has one.
+void yb::PPU::tickFifo()
+{
+    switch (fetchStep_) {
+    case 0:
+        fetchTileIndex();
+        break;
+    case 2:
+        fetchTileData(false);
+        break;
+    case 4:
+        fetchTileData(true);
+        break;
+    default:
+        break;
+    }
+
+    // the fetcher waits with a whole tile until the FIFO runs dry
+    if (fetchStep_ < 6) {
+        ++fetchStep_;
+    } else if (fifoHead_ == 8) {
+        pushTile();
+        fetchStep_ = 0;
+        ++fetchX_;
+    }
+
+    shiftPixel();
+}
+
+void yb::PPU::fetchTileIndex()
+{
+    const uint8_t lcdc = mmu_->peek8(LCDC);
+
+    uint16_t map;
+    uint8_t column;
+    uint8_t y;
+    if (fetchWindow_) {
+        map = (lcdc & 0x40) ? 0x1C00 : 0x1800;
+        column = fetchX_ & 0x1F;
+        y = windowLine_;
+    } else {
+        map = (lcdc & 0x08) ? 0x1C00 : 0x1800;
+        column = (mmu_->peek8(SCX) / 8 + fetchX_) & 0x1F;
+        y = ly_ + mmu_->peek8(SCY);
+    }
+
+    const uint16_t entry = map + (y / 8) * 32 + column;
+    fetchIndex_ = mmu_->vram(0)[entry];
+    fetchAttribute_ = colors_ ? mmu_->vram(1)[entry] : 0;
+}
+
+// The row is worked out again on each read, so a write to SCY between the
+// two halves of a fetch mixes rows like the hardware does.
+void yb::PPU::fetchTileData(bool high)
+{
+    const uint8_t lcdc = mmu_->peek8(LCDC);
+
+    uint8_t row = (fetchWindow_ ? windowLine_ : ly_ + mmu_->peek8(SCY)) % 8;
+    if (fetchAttribute_ & 0x40) {
+        row = 7 - row;
+    }
+
+    const uint8_t bank = (fetchAttribute_ & 0x08) ? 1 : 0;
+    const uint8_t* tile = mmu_->vram(bank) + (tile_address(lcdc, fetchIndex_) - 0x8000) + row * 2;
+    if (high) {
+        fetchHi_ = tile[1];
+    } else {
+        fetchLo_ = tile[0];
+    }
+}
+
+void yb::PPU::pushTile()
+{
+    const uint8_t extra = (fetchAttribute_ & 0x07) << 2 | (fetchAttribute_ & BG_PRIORITY);
+    for (uint8_t i = 0; i < 8; ++i) {
+        const uint8_t x = (fetchAttribute_ & 0x20) ? 7 - i : i;
+        fifoPixels_[i] = row_pixel(fetchLo_, fetchHi_, x) | extra;
+    }
+    fifoHead_ = 0;
+}
+
+// Reaching WX throws away what the FIFO holds and restarts the fetcher on the
+// window, which costs the transfer a fetch like on the hardware.
+void yb::PPU::shiftPixel()
+{
+    const uint8_t lcdc = mmu_->peek8(LCDC);
+
+    const bool windowEnabled = (lcdc & 0xA0) == 0xA0 && (colors_ || (lcdc & 0x01));
+    const int wx = mmu_->peek8(WX) - 7;
+    if (!fetchWindow_ && windowEnabled && ly_ >= mmu_->peek8(WY) && fifoX_ >= wx) {
+        fetchWindow_ = true;
+        windowUsed_ = true;
+        fifoHead_ = 8;
+        fetchStep_ = 0;
+        fetchX_ = 0;
+        fifoDiscard_ = wx < 0 ? -wx : 0;
+        return;
+    }
+
+    if (fifoHead_ == 8) {
+        return;
+    }
+
+    uint8_t pixel = fifoPixels_[fifoHead_++];
+    if (fifoDiscard_ > 0) {
+        --fifoDiscard_;
+        return;
+    }
+
+    const uint8_t x = fifoX_++;
+    if ((lcdc & 0x80) == 0) {
+        fifoLine_[x] = SHADES[0];
+        return;
+    }
+
+    // a DMG without the background shows color 0 there
+    if (!colors_ && (lcdc & 0x01) == 0) {
+        pixel = 0;
+    }
+
+    const uint8_t sprite = spriteColors_[x];
+    const bool bgPriority = !colors_ || (lcdc & 0x01);
+    if ((lcdc & 0x02) && sprite != 0 && sprite_shows(pixel, spriteFlags_[x], bgPriority)) {
+        fifoLine_[x] = spriteColor(sprite, spriteFlags_[x]);
+    } else {
+        fifoLine_[x] = backgroundColor(pixel);
+    }
+}
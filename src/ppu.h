@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mmu.h"
+#include "savestate.h"
+
+#define YB_SCREEN_WIDTH (160)
+#define YB_SCREEN_HEIGHT (144)
+
+namespace yb {
+
+    enum class PPUMode : uint8_t
+    {
+        HBLANK = 0,
+        VBLANK = 1,
+        OAM_SEARCH = 2,
+        TRANSFER = 3
+    };
+
+    enum class PPUEngine : uint8_t
+    {
+        // Each line is drawn in one go when its pixel transfer ends.
+        SCANLINE,
+        // Pixels are fetched and shifted out of a FIFO dot by dot, so
+        // registers written during the transfer change the rest of the line.
+        FIFO,
+        // SCANLINE, except that a line switches to FIFO at the first PPU
+        // register write during its transfer.
+        AUTO
+    };
+
+    // Parses "scanline", "fifo" or "auto".
+    bool parse_ppu_engine(const std::string& name, yb::PPUEngine& engine);
+
+    // Draws lines with the scanline renderer or the pixel FIFO, see yb::PPUEngine.
+    // On a CGB MMU lines are drawn with the tile attributes and color palettes.
+    //
+    // The scanline renderer copies the background and window out of layers:
+    // each tile map drawn in full, 256x256, once for either tile data area.
+    // VRAM writes bump the version of the tiles they touch or forget the map
+    // entries they touch, and a line only redraws the entries of the map row
+    // it needs that are out of date, so it usually costs two copies and a
+    // palette lookup per pixel.
+    //
+    // The transfer always lasts 172 dots whichever engine draws the line. The
+    // FIFO shifts out one pixel a dot once its first tile is fetched, and
+    // whatever it hasn't when the transfer ends is finished then.
+    class PPU : public yb::DisplayListener
+    {
+    public:
+        PPU(yb::MMU* mmu);
+        ~PPU();
+
+        // Takes effect from the next line.
+        void setEngine(yb::PPUEngine engine);
+        yb::PPUEngine engine() const;
+
+        // Advances the PPU by the given number of CPU cycles.
+        // Returns true if a frame was completed (VBlank was entered).
+        bool step(uint8_t cycles);
+
+        // ARGB8888 pixels, YB_SCREEN_WIDTH x YB_SCREEN_HEIGHT.
+        const uint32_t* framebuffer() const;
+
+        // One flag per line, set when the line's pixels changed since the last
+        // clearDirtyLines(). All lines start out dirty.
+        const bool* dirtyLines() const;
+        void clearDirtyLines();
+
+        // The framebuffer is not saved: it is redrawn in full before the next frame completes.
+        // Neither is the state of a pixel FIFO: a line loaded mid-transfer is
+        // finished by the scanline renderer.
+        void save(yb::StateWriter& writer) const;
+        void load(yb::StateReader& reader);
+
+    private:
+        void setMode(PPUMode mode);
+        void setLY(uint8_t ly);
+
+        void onDisplayWrite(uint16_t addr, uint8_t value) override;
+        void onVramWrite(uint8_t bank, uint16_t offset, uint16_t length) override;
+
+        void renderLine();
+        void presentLine(const uint32_t* line);
+        void drawLine(uint32_t* line, uint8_t* background);
+        void drawSprites(uint32_t* line, const uint8_t* background, uint8_t lcdc);
+        bool fetchSprites(uint8_t lcdc, uint8_t* colors, uint8_t* flags);
+        void buildSpriteLines(uint8_t height);
+
+        const uint8_t* layerRow(uint8_t lcdc, uint8_t mapBit, uint8_t y);
+
+        uint32_t backgroundColor(uint8_t pixel) const;
+        uint32_t spriteColor(uint8_t color, uint8_t flags) const;
+
+        void startFifo();
+        void runFifo(uint16_t dots);
+        void finishFifo();
+        void tickFifo();
+        void fetchTileIndex();
+        void fetchTileData(bool high);
+        void pushTile();
+        void shiftPixel();
+
+        // Pixels here and in the FIFO are the 2 bit color, the CGB palette in
+        // bits 2-4 and BG_PRIORITY.
+        struct TileLayer {
+            TileLayer();
+
+            // 256x256, allocated when first drawn through
+            std::vector<uint8_t> pixels;
+            // version of the tile each map entry was drawn with, 0 to redraw it
+            uint32_t drawn[32 * 32];
+            // vramVersion_ as of when each row of map entries was last checked
+            uint32_t checked[32];
+        };
+
+        // OAM indices of the sprites a line shows, at most 10 like the
+        // hardware, in priority order.
+        struct SpriteLine {
+            uint8_t count;
+            uint8_t sprites[10];
+        };
+
+        yb::MMU* mmu_;
+        yb::PPUEngine engine_;
+
+        // RGB555 to ARGB8888, shared by every CGB PPU; null on a DMG
+        const uint32_t* colors_;
+
+        PPUMode mode_;
+        uint16_t dots_;
+        uint8_t ly_;
+        uint8_t windowLine_;
+
+        uint32_t framebuffer_[YB_SCREEN_WIDTH * YB_SCREEN_HEIGHT];
+        bool dirtyLines_[YB_SCREEN_HEIGHT];
+
+        // Rebuilt from a copy of OAM only when the MMU reports OAM changed or
+        // the sprite height did; every line's selection is then a lookup.
+        SpriteLine spriteLines_[YB_SCREEN_HEIGHT];
+        uint8_t oam_[160];
+        uint32_t spriteGeneration_;
+        // 8 or 16 as of the last rebuild, 0 when the cache is stale
+        uint8_t spriteHeight_;
+
+        // by map (0x9800 or 0x9C00) and then tile data area (0x8800 or 0x8000)
+        TileLayer layers_[4];
+        // bumped by every write to the tile of either bank, starting at 1
+        uint32_t tileVersions_[2 * 384];
+        // bumped by every VRAM write
+        uint32_t vramVersion_;
+
+        // The pixel FIFO drawing the current line, if fifoActive_.
+        bool fifoActive_;
+        // transfer dots run so far
+        uint16_t fifoDots_;
+        // next pixel of the line to shift out
+        uint8_t fifoX_;
+        // pixels to shift out and drop: SCX % 8, or the window's overhang past the left edge
+        uint8_t fifoDiscard_;
+        uint8_t fifoPixels_[8];
+        // index of the next pixel in fifoPixels_, 8 when empty
+        uint8_t fifoHead_;
+        // dot of the current tile fetch: the index at 0, the data at 2 and 4, pushed from 6
+        uint8_t fetchStep_;
+        // tile column from the left of the background view or of the window
+        uint8_t fetchX_;
+        bool fetchWindow_;
+        bool windowUsed_;
+        uint8_t fetchIndex_;
+        uint8_t fetchAttribute_;
+        uint8_t fetchLo_;
+        uint8_t fetchHi_;
+        uint32_t fifoLine_[YB_SCREEN_WIDTH];
+        // the sprite pixel above each x as fetched when the line started, color 0 where none
+        uint8_t spriteColors_[YB_SCREEN_WIDTH];
+        uint8_t spriteFlags_[YB_SCREEN_WIDTH];
+    };
+}
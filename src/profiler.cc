@@ -0,0 +1,108 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
+#include "ops.h"
+
+namespace yb {
+
+static const char* mnemonic(uint16_t key)
+{
+    const auto& table = (key & 0x100) ? yb::PREFIXED_INSTRUCTIONS : yb::INSTRUCTIONS;
+
+    const auto it = table.find(key & 0xFF);
+    if (it == table.end()) {
+        return "???";
+    }
+
+    return it->second.mnemonic.c_str();
+}
+
+} // end namespace
+
+yb::OpcodeProfile::OpcodeProfile()
+    : untilSample_(SAMPLE_INTERVAL)
+    , rng_(0x2545F491)
+{
+    std::memset(entries_, 0, sizeof(entries_));
+}
+
+void yb::OpcodeProfile::record(uint16_t key, uint8_t cycles)
+{
+    entries_[key].count += 1;
+    entries_[key].cycles += cycles;
+}
+
+void yb::OpcodeProfile::sample(uint16_t key, uint64_t nanos)
+{
+    entries_[key].samples += 1;
+    entries_[key].sampledNanos += nanos;
+}
+
+bool yb::OpcodeProfile::shouldSample()
+{
+    if (--untilSample_ != 0) {
+        return false;
+    }
+
+    // Jitter the interval (xorshift) so tight guest loops don't alias with it
+    // and always put the same instruction under the clock.
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 17;
+    rng_ ^= rng_ << 5;
+    untilSample_ = 1 + rng_ % (2 * SAMPLE_INTERVAL - 1);
+
+    return true;
+}
+
+void yb::OpcodeProfile::report(std::FILE* out) const
+{
+    std::vector<uint16_t> keys;
+    uint64_t totalCount = 0;
+    uint64_t totalCycles = 0;
+    for (uint16_t key = 0; key < 0x200; ++key) {
+        if (entries_[key].count != 0) {
+            keys.push_back(key);
+            totalCount += entries_[key].count;
+            totalCycles += entries_[key].cycles;
+        }
+    }
+
+    if (totalCount == 0) {
+        return;
+    }
+
+    std::sort(keys.begin(), keys.end(), [this](uint16_t a, uint16_t b) {
+        return entries_[a].cycles > entries_[b].cycles;
+    });
+
+    std::fprintf(out, "%-6s %-16s %12s %7s %14s %7s %9s %12s\n",
+        "opcode", "mnemonic", "count", "count%", "cycles", "cycle%", "ns/op", "est. host ms");
+
+    for (uint16_t key : keys) {
+        const Entry& entry = entries_[key];
+
+        // host time is extrapolated from the sampled subset of executions
+        const double nsPerOp = entry.samples ? (double) entry.sampledNanos / entry.samples : 0.0;
+
+        char opcode[8];
+        if (key & 0x100) {
+            std::snprintf(opcode, sizeof(opcode), "CB %02X", key & 0xFF);
+        } else {
+            std::snprintf(opcode, sizeof(opcode), "%02X", key);
+        }
+
+        std::fprintf(out, "%-6s %-16s %12" PRIu64 " %6.2f%% %14" PRIu64 " %6.2f%% %9.1f %12.3f\n",
+            opcode,
+            mnemonic(key),
+            entry.count,
+            100.0 * entry.count / totalCount,
+            entry.cycles,
+            100.0 * entry.cycles / totalCycles,
+            nsPerOp,
+            nsPerOp * entry.count / 1e6);
+    }
+}
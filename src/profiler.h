@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+namespace yb {
+
+    // Per-opcode execution counts, cycles and sampled host time.
+    // Only fed by profiling builds (YB_PROFILE), see CPU::tick().
+    class OpcodeProfile
+    {
+    public:
+        // Host time is measured on one instruction out of this many, on average.
+        static constexpr uint32_t SAMPLE_INTERVAL = 64;
+
+        OpcodeProfile();
+
+        // Keys are the opcode, or 0x100 | opcode for CB-prefixed instructions.
+        void record(uint16_t key, uint8_t cycles);
+        void sample(uint16_t key, uint64_t nanos);
+
+        // True if the next instruction should be timed.
+        bool shouldSample();
+
+        // Writes a table of every executed opcode, sorted by cycles spent.
+        void report(std::FILE* out) const;
+
+    private:
+        struct Entry {
+            uint64_t count;
+            uint64_t cycles;
+            uint64_t samples;
+            uint64_t sampledNanos;
+        };
+
+        Entry entries_[0x200];
+        uint32_t untilSample_;
+        uint32_t rng_;
+    };
+
+}
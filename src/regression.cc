@@ -0,0 +1,190 @@
+#include "regression.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "common.h"
+#include "joypad.h"
+
+namespace yb {
+
+static bool parse_buttons(char* text, uint8_t& buttons)
+{
+    static const struct {
+        const char* name;
+        uint8_t button;
+    } NAMES[] = {
+        { "RIGHT", BUTTON_RIGHT },
+        { "LEFT", BUTTON_LEFT },
+        { "UP", BUTTON_UP },
+        { "DOWN", BUTTON_DOWN },
+        { "A", BUTTON_A },
+        { "B", BUTTON_B },
+        { "SELECT", BUTTON_SELECT },
+        { "START", BUTTON_START },
+    };
+
+    buttons = 0;
+    if (std::strcmp(text, "-") == 0) {
+        return true;
+    }
+
+    for (char* name = text; name; ) {
+        char* next = std::strchr(name, '+');
+        if (next) {
+            *next++ = '\0';
+        }
+
+        bool found = false;
+        for (const auto& entry : NAMES) {
+            if (std::strcmp(name, entry.name) == 0) {
+                buttons |= entry.button;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            return false;
+        }
+        name = next;
+    }
+
+    return true;
+}
+
+static bool read_golden(const char* path, std::vector<uint64_t>& hashes)
+{
+    std::FILE* file = std::fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    char line[256];
+    while (std::fgets(line, sizeof(line), file)) {
+        line[std::strcspn(line, "#\r\n")] = '\0';
+
+        char* end = nullptr;
+        const uint64_t hash = std::strtoull(line, &end, 16);
+        if (end != line) {
+            hashes.push_back(hash);
+        }
+    }
+    std::fclose(file);
+
+    return true;
+}
+
+} // end namespace
+
+bool yb::InputScript::load(const char* path)
+{
+    std::FILE* file = std::fopen(path, "r");
+    if (!file) {
+        yb::error("Could not read input script %s.\n", path);
+        return false;
+    }
+
+    entries_.clear();
+
+    char line[256];
+    int lineNumber = 0;
+    while (std::fgets(line, sizeof(line), file)) {
+        ++lineNumber;
+        line[std::strcspn(line, "#\r\n")] = '\0';
+
+        int frame = 0;
+        char buttons[200];
+        const int fields = std::sscanf(line, "%d %199s", &frame, buttons);
+        if (fields <= 0) {
+            continue;
+        }
+
+        Entry entry = { frame, 0 };
+        if (fields != 2 || frame < 0 || !parse_buttons(buttons, entry.buttons)) {
+            yb::error("%s:%d: expected '<frame> <buttons>'.\n", path, lineNumber);
+            std::fclose(file);
+            return false;
+        }
+        entries_.push_back(entry);
+    }
+    std::fclose(file);
+
+    std::stable_sort(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+        return a.frame < b.frame;
+    });
+
+    return true;
+}
+
+uint8_t yb::InputScript::buttonsAt(int frame) const
+{
+    auto next = std::upper_bound(entries_.begin(), entries_.end(), frame, [](int f, const Entry& e) {
+        return f < e.frame;
+    });
+
+    if (next == entries_.begin()) {
+        return 0;
+    }
+
+    return (next - 1)->buttons;
+}
+
+int yb::run_regression(yb::Emulator& emulator, const InputScript& input, int frames, const char* goldenPath, bool record)
+{
+    std::vector<uint64_t> golden;
+    if (!record && !read_golden(goldenPath, golden)) {
+        yb::error("Could not read golden file %s.\n", goldenPath);
+        return 1;
+    }
+
+    std::vector<uint64_t> hashes;
+    hashes.reserve(frames);
+
+    for (int frame = 0; frame < frames; ++frame) {
+        emulator.setInput(input.buttonsAt(frame));
+        emulator.runFrame();
+
+        const uint64_t hash = emulator.frameHash();
+        if (!record) {
+            if ((size_t) frame >= golden.size()) {
+                yb::error("Golden file %s only covers %zu frames.\n", goldenPath, golden.size());
+                return 1;
+            }
+
+            if (golden[frame] != hash) {
+                yb::error(
+                    "Frame %d diverged: expected %016" PRIx64 ", got %016" PRIx64 ".\n",
+                    frame,
+                    golden[frame],
+                    hash
+                );
+                return 1;
+            }
+        }
+        hashes.push_back(hash);
+    }
+
+    if (!record) {
+        std::printf("All %d frames match %s.\n", frames, goldenPath);
+        return 0;
+    }
+
+    std::FILE* file = std::fopen(goldenPath, "w");
+    if (!file) {
+        yb::error("Could not write golden file %s.\n", goldenPath);
+        return 1;
+    }
+
+    std::fprintf(file, "# yoboy golden frame hashes (XXH64), one per frame\n");
+    for (uint64_t hash : hashes) {
+        std::fprintf(file, "%016" PRIx64 "\n", hash);
+    }
+    std::fclose(file);
+
+    std::printf("Recorded %d frame hashes to %s.\n", frames, goldenPath);
+
+    return 0;
+}
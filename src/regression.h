@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "emulator.h"
+
+namespace yb {
+
+    // Scripted joypad input, one "<frame> <buttons>" entry per line.
+    // Buttons (RIGHT, LEFT, UP, DOWN, A, B, SELECT, START) are joined with '+',
+    // or '-' for none, and stay held until the next entry. '#' starts a comment.
+    class InputScript
+    {
+    public:
+        bool load(const char* path);
+
+        // Buttons held during the given frame (see yb::Button).
+        uint8_t buttonsAt(int frame) const;
+
+    private:
+        struct Entry {
+            int frame;
+            uint8_t buttons;
+        };
+
+        // sorted by frame
+        std::vector<Entry> entries_;
+    };
+
+    // Runs the emulator headlessly for the given number of frames, feeding the
+    // scripted input and hashing every frame. When recording, the hashes are
+    // written to the golden file; otherwise they are compared against it and the
+    // first divergent frame is reported.
+    // Returns 0 on success, 1 on divergence or I/O errors.
+    int run_regression(yb::Emulator& emulator, const InputScript& input, int frames, const char* goldenPath, bool record);
+
+}
@@ -0,0 +1,199 @@
+#include "save_ram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+
+namespace yb {
+
+static constexpr std::chrono::seconds SYNC_INTERVAL(1);
+
+// Writes all of data or fails, retrying short writes.
+static bool write_all(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t written = ::write(fd, data, size);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+} // end namespace
+
+yb::SaveRam::SaveRam()
+    : fd_(-1)
+    , mapping_(nullptr)
+    , size_(0)
+    , closing_(false)
+    , failed_(false)
+{}
+
+yb::SaveRam::~SaveRam()
+{
+    close();
+}
+
+bool yb::SaveRam::open(const std::string& path, size_t size)
+{
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        yb::error("Could not open %s.\n", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        yb::error("Could not read %s.\n", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    path_ = path;
+    size_ = size;
+
+    // mapping past the end of the file would fault, so it has to grow first
+    const bool sized = (size_t) st.st_size >= size || ::ftruncate(fd, size) == 0;
+    void* mapping = sized ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (mapping != MAP_FAILED) {
+        fd_ = fd;
+        mapping_ = (uint8_t*) mapping;
+    } else {
+        yb::log("Could not map %s, rewriting it on changes instead.\n", path.c_str());
+
+        std::vector<uint8_t> contents(st.st_size);
+        const bool read = ::pread(fd, contents.data(), contents.size(), 0) == (ssize_t) contents.size();
+        ::close(fd);
+        if (!read) {
+            yb::error("Could not read %s.\n", path.c_str());
+            return false;
+        }
+
+        buffer_.assign(size, 0);
+        std::memcpy(buffer_.data(), contents.data(), std::min(size, contents.size()));
+        if (contents.size() > size) {
+            tail_.assign(contents.begin() + size, contents.end());
+        }
+        written_ = buffer_;
+    }
+
+    closing_ = false;
+    failed_ = false;
+    thread_ = std::thread(&SaveRam::run, this);
+
+    return true;
+}
+
+bool yb::SaveRam::close()
+{
+    if (!thread_.joinable()) {
+        return !failed_;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+
+    const bool flushed = flush();
+
+    if (mapping_) {
+        ::munmap(mapping_, size_);
+        ::close(fd_);
+        mapping_ = nullptr;
+        fd_ = -1;
+    }
+    buffer_.clear();
+    written_.clear();
+    tail_.clear();
+
+    return flushed && !failed_;
+}
+
+uint8_t* yb::SaveRam::data()
+{
+    return mapping_ ? mapping_ : buffer_.data();
+}
+
+size_t yb::SaveRam::size() const
+{
+    return size_;
+}
+
+bool yb::SaveRam::isMapped() const
+{
+    return mapping_ != nullptr;
+}
+
+bool yb::SaveRam::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bool ok;
+    if (mapping_) {
+        ok = ::msync(mapping_, size_, MS_SYNC) == 0;
+    } else {
+        ok = rewrite();
+    }
+
+    if (!ok && !failed_) {
+        yb::error("Could not save to %s.\n", path_.c_str());
+        failed_ = true;
+    }
+
+    return ok;
+}
+
+// Runs with mutex_ held. The game may be writing the RAM meanwhile; the copy
+// is then as consistent as the RAM itself is at that moment, and the next
+// flush writes it again.
+bool yb::SaveRam::rewrite()
+{
+    if (std::memcmp(buffer_.data(), written_.data(), size_) == 0) {
+        return true;
+    }
+    const std::vector<uint8_t> snapshot(buffer_);
+
+    const std::string temp = path_ + ".tmp";
+    const int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    const bool written = write_all(fd, snapshot.data(), size_)
+        && write_all(fd, tail_.data(), tail_.size())
+        && ::fsync(fd) == 0;
+    ::close(fd);
+
+    if (!written || std::rename(temp.c_str(), path_.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+
+    written_ = snapshot;
+    return true;
+}
+
+void yb::SaveRam::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!changed_.wait_for(lock, SYNC_INTERVAL, [this] { return closing_; })) {
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
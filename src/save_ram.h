@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace yb {
+
+    // Battery backed cartridge RAM persisted to a .sav file.
+    //
+    // The file is mapped shared, so every write the game makes lands straight
+    // in the page cache and outlives the emulator crashing; a background
+    // thread msyncs it every second so it reaches the disk as well. Where the
+    // file can't be mapped the RAM is kept in memory and the thread rewrites
+    // the file whenever it changed, writing a temporary file and renaming it
+    // over the old one so that a crash never leaves half a save behind.
+    class SaveRam
+    {
+    public:
+        SaveRam();
+        ~SaveRam();
+
+        // Opens path, creating it or growing it with zeroes to size bytes. A
+        // longer file, like one with a real time clock appended by another
+        // emulator, keeps the bytes past size untouched.
+        bool open(const std::string& path, size_t size);
+
+        // Writes the RAM out a last time and stops the background thread.
+        // Returns false if anything failed to reach the file.
+        bool close();
+
+        uint8_t* data();
+        size_t size() const;
+
+        // False when the RAM is rewritten to the file rather than mapped.
+        bool isMapped() const;
+
+        // Brings the file up to date with the RAM as it is now.
+        bool flush();
+
+    private:
+        SaveRam(const SaveRam&) = delete;
+        SaveRam& operator=(const SaveRam&) = delete;
+
+        void run();
+        bool rewrite();
+
+        std::string path_;
+        int fd_;
+        uint8_t* mapping_;
+        size_t size_;
+
+        // The RAM when it isn't mapped, what of it the file last got and the
+        // bytes past it the file had.
+        std::vector<uint8_t> buffer_;
+        std::vector<uint8_t> written_;
+        std::vector<uint8_t> tail_;
+
+        std::thread thread_;
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        bool closing_;
+        bool failed_;
+    };
+
+}
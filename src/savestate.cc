@@ -0,0 +1,104 @@
+#include "savestate.h"
+
+#include <cstring>
+
+yb::StateWriter::StateWriter(std::vector<uint8_t>& out)
+    : out_(out)
+{}
+
+void yb::StateWriter::write8(uint8_t value)
+{
+    out_.push_back(value);
+}
+
+void yb::StateWriter::write16(uint16_t value)
+{
+    write8(value & 0xFF);
+    write8(value >> 8);
+}
+
+void yb::StateWriter::write32(uint32_t value)
+{
+    write16(value & 0xFFFF);
+    write16(value >> 16);
+}
+
+void yb::StateWriter::write64(uint64_t value)
+{
+    write32(value & 0xFFFFFFFF);
+    write32(value >> 32);
+}
+
+void yb::StateWriter::writeBytes(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out_.insert(out_.end(), bytes, bytes + size);
+}
+
+yb::StateReader::StateReader(const uint8_t* data, size_t size)
+    : data_(data)
+    , size_(size)
+    , pos_(0)
+    , ok_(true)
+{}
+
+uint8_t yb::StateReader::read8()
+{
+    if (pos_ >= size_) {
+        ok_ = false;
+        return 0;
+    }
+
+    return data_[pos_++];
+}
+
+uint16_t yb::StateReader::read16()
+{
+    const uint16_t lo = read8();
+    const uint16_t hi = read8();
+
+    return hi << 8 | lo;
+}
+
+uint32_t yb::StateReader::read32()
+{
+    const uint32_t lo = read16();
+    const uint32_t hi = read16();
+
+    return hi << 16 | lo;
+}
+
+uint64_t yb::StateReader::read64()
+{
+    const uint64_t lo = read32();
+    const uint64_t hi = read32();
+
+    return hi << 32 | lo;
+}
+
+void yb::StateReader::readBytes(void* data, size_t size)
+{
+    if (size > size_ - pos_) {
+        ok_ = false;
+        std::memset(data, 0, size);
+        return;
+    }
+
+    std::memcpy(data, data_ + pos_, size);
+    pos_ += size;
+}
+
+size_t yb::StateReader::remaining() const
+{
+    return size_ - pos_;
+}
+
+void yb::StateReader::fail()
+{
+    ok_ = false;
+}
+
+bool yb::StateReader::ok() const
+{
+    return ok_;
+}
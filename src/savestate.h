@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace yb {
+
+    // Appends machine state to a byte buffer in a fixed little endian layout.
+    class StateWriter
+    {
+    public:
+        StateWriter(std::vector<uint8_t>& out);
+
+        void write8(uint8_t value);
+        void write16(uint16_t value);
+        void write32(uint32_t value);
+        void write64(uint64_t value);
+
+        void writeBytes(const void* data, size_t size);
+
+    private:
+        std::vector<uint8_t>& out_;
+    };
+
+    // Reads back state produced by StateWriter.
+    // Reads past the end of the buffer return zeroes and clear ok().
+    class StateReader
+    {
+    public:
+        StateReader(const uint8_t* data, size_t size);
+
+        uint8_t read8();
+        uint16_t read16();
+        uint32_t read32();
+        uint64_t read64();
+
+        void readBytes(void* data, size_t size);
+
+        // Bytes left to read, for checking lengths taken from the data itself
+        // before allocating for them.
+        size_t remaining() const;
+
+        // Clears ok(), for data that was read fine but makes no sense.
+        void fail();
+
+        bool ok() const;
+
+    private:
+        const uint8_t* data_;
+        size_t size_;
+        size_t pos_;
+        bool ok_;
+    };
+}
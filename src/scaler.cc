@@ -0,0 +1,319 @@
+#include "scaler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace yb {
+
+static size_t default_threads()
+{
+    // emulation keeps one core for itself
+    const size_t cores = std::thread::hardware_concurrency();
+    return std::min<size_t>(std::max<size_t>(cores, 2) - 1, 4);
+}
+
+static int fixed_factor(yb::Filter filter, int factor)
+{
+    switch (filter) {
+    case yb::Filter::SCALE2X: return 2;
+    case yb::Filter::SCALE3X: return 3;
+    case yb::Filter::XBR2X:   return 2;
+    case yb::Filter::XBR4X:   return 4;
+    default:                  return std::max(factor, 1);
+    }
+}
+
+static void nearest(const uint32_t* src, int width, int, int factor, uint32_t* dst, int first, int last)
+{
+    const int pitch = width * factor;
+    for (int y = first; y < last; ++y) {
+        const uint32_t* in = src + y * width;
+        uint32_t* out = dst + y * factor * pitch;
+
+        for (int x = 0; x < width; ++x) {
+            std::fill_n(out + x * factor, factor, in[x]);
+        }
+        for (int i = 1; i < factor; ++i) {
+            std::memcpy(out + i * pitch, out, pitch * sizeof(uint32_t));
+        }
+    }
+}
+
+// Neighbours are named after their position around E:
+//   A B C
+//   D E F
+//   G H I
+// and the edges of the frame are clamped.
+
+static void scale2x(const uint32_t* src, int width, int height, int, uint32_t* dst, int first, int last)
+{
+    const int pitch = width * 2;
+    for (int y = first; y < last; ++y) {
+        const uint32_t* above = src + std::max(y - 1, 0) * width;
+        const uint32_t* row = src + y * width;
+        const uint32_t* below = src + std::min(y + 1, height - 1) * width;
+        uint32_t* out = dst + y * 2 * pitch;
+
+        for (int x = 0; x < width; ++x) {
+            const int left = std::max(x - 1, 0);
+            const int right = std::min(x + 1, width - 1);
+            const uint32_t B = above[x], D = row[left], E = row[x], F = row[right], H = below[x];
+
+            uint32_t* o = out + x * 2;
+            if (B != H && D != F) {
+                o[0]         = D == B ? D : E;
+                o[1]         = B == F ? F : E;
+                o[pitch]     = D == H ? D : E;
+                o[pitch + 1] = H == F ? F : E;
+            } else {
+                o[0] = o[1] = o[pitch] = o[pitch + 1] = E;
+            }
+        }
+    }
+}
+
+static void scale3x(const uint32_t* src, int width, int height, int, uint32_t* dst, int first, int last)
+{
+    const int pitch = width * 3;
+    for (int y = first; y < last; ++y) {
+        const uint32_t* above = src + std::max(y - 1, 0) * width;
+        const uint32_t* row = src + y * width;
+        const uint32_t* below = src + std::min(y + 1, height - 1) * width;
+        uint32_t* out = dst + y * 3 * pitch;
+
+        for (int x = 0; x < width; ++x) {
+            const int left = std::max(x - 1, 0);
+            const int right = std::min(x + 1, width - 1);
+            const uint32_t A = above[left], B = above[x], C = above[right];
+            const uint32_t D = row[left], E = row[x], F = row[right];
+            const uint32_t G = below[left], H = below[x], I = below[right];
+
+            uint32_t* o0 = out + x * 3;
+            uint32_t* o1 = o0 + pitch;
+            uint32_t* o2 = o1 + pitch;
+            if (B != H && D != F) {
+                o0[0] = D == B ? D : E;
+                o0[1] = (D == B && E != C) || (B == F && E != A) ? B : E;
+                o0[2] = B == F ? F : E;
+                o1[0] = (D == B && E != G) || (D == H && E != A) ? D : E;
+                o1[1] = E;
+                o1[2] = (B == F && E != I) || (H == F && E != C) ? F : E;
+                o2[0] = D == H ? D : E;
+                o2[1] = (D == H && E != I) || (H == F && E != G) ? H : E;
+                o2[2] = H == F ? F : E;
+            } else {
+                o0[0] = o0[1] = o0[2] = o1[0] = o1[1] = o1[2] = o2[0] = o2[1] = o2[2] = E;
+            }
+        }
+    }
+}
+
+// Weighted distance between two colours in YUV, luma counting most.
+static int distance(uint32_t a, uint32_t b)
+{
+    const int r = (int)((a >> 16) & 0xFF) - (int)((b >> 16) & 0xFF);
+    const int g = (int)((a >> 8) & 0xFF) - (int)((b >> 8) & 0xFF);
+    const int bl = (int)(a & 0xFF) - (int)(b & 0xFF);
+
+    const int y = (299 * r + 587 * g + 114 * bl) / 1000;
+    const int u = (-169 * r - 331 * g + 500 * bl) / 1000;
+    const int v = (500 * r - 419 * g - 81 * bl) / 1000;
+
+    return 48 * std::abs(y) + 7 * std::abs(u) + 6 * std::abs(v);
+}
+
+static bool similar(uint32_t a, uint32_t b)
+{
+    return distance(a, b) < 155;
+}
+
+// dst moves alpha / 256 of the way towards src, channel by channel.
+static void blend(uint32_t& dst, uint32_t src, int alpha)
+{
+    uint32_t out = 0xFF000000;
+    for (int shift = 0; shift < 24; shift += 8) {
+        const int d = (dst >> shift) & 0xFF;
+        const int s = (src >> shift) & 0xFF;
+        out |= (uint32_t)(d + (((s - d) * alpha) >> 8)) << shift;
+    }
+    dst = out;
+}
+
+// One corner of 2xBR: whether an edge runs across the corner of E between H
+// and F, and if so how far along the neighbouring sub-pixels it reaches.
+// The 5x5 neighbourhood is rotated so that the corner is always bottom right:
+//      A1 B1 C1
+//   A0 A  B  C  C4
+//   D0 D  E  F  F4
+//   G0 G  H  I  I4
+//      G5 H5 I5
+// n1, n2 and n3 are the sub-pixels to the top right, bottom left and bottom
+// right of the 2x2 output.
+static void xbr_corner(uint32_t E, uint32_t I, uint32_t H, uint32_t F, uint32_t G, uint32_t C,
+    uint32_t D, uint32_t B, uint32_t F4, uint32_t I4, uint32_t H5, uint32_t I5,
+    uint32_t& n1, uint32_t& n2, uint32_t& n3)
+{
+    if (E == H || E == F) {
+        return;
+    }
+
+    const int across = distance(E, C) + distance(E, G) + distance(I, H5) + distance(I, F4) + 4 * distance(H, F);
+    const int along = distance(H, D) + distance(H, I5) + distance(F, I4) + distance(F, B) + 4 * distance(E, I);
+
+    const uint32_t px = distance(E, F) <= distance(E, H) ? F : H;
+    if (across < along &&
+        ((!similar(F, B) && !similar(H, D)) || (similar(E, I) && !similar(F, I4) && !similar(H, I5)) ||
+         similar(E, G) || similar(E, C))) {
+        const int ke = distance(F, G);
+        const int ki = distance(H, C);
+        const bool shallow = 2 * ke <= ki && E != G && D != G;
+        const bool steep = ke >= 2 * ki && E != C && B != C;
+
+        if (shallow && steep) {
+            blend(n3, px, 224);
+            blend(n2, px, 64);
+            n1 = n2;
+        } else if (shallow) {
+            blend(n3, px, 192);
+            blend(n2, px, 64);
+        } else if (steep) {
+            blend(n3, px, 192);
+            blend(n1, px, 64);
+        } else {
+            blend(n3, px, 128);
+        }
+    } else if (across <= along) {
+        blend(n3, px, 128);
+    }
+}
+
+static void xbr2x(const uint32_t* src, int width, int height, int, uint32_t* dst, int first, int last)
+{
+    const int pitch = width * 2;
+    for (int y = first; y < last; ++y) {
+        const uint32_t* r[5];
+        for (int i = 0; i < 5; ++i) {
+            r[i] = src + std::min(std::max(y + i - 2, 0), height - 1) * width;
+        }
+        uint32_t* out = dst + y * 2 * pitch;
+
+        for (int x = 0; x < width; ++x) {
+            int c[5];
+            for (int i = 0; i < 5; ++i) {
+                c[i] = std::min(std::max(x + i - 2, 0), width - 1);
+            }
+
+            const uint32_t A1 = r[0][c[1]], B1 = r[0][c[2]], C1 = r[0][c[3]];
+            const uint32_t A0 = r[1][c[0]], A = r[1][c[1]], B = r[1][c[2]], C = r[1][c[3]], C4 = r[1][c[4]];
+            const uint32_t D0 = r[2][c[0]], D = r[2][c[1]], E = r[2][c[2]], F = r[2][c[3]], F4 = r[2][c[4]];
+            const uint32_t G0 = r[3][c[0]], G = r[3][c[1]], H = r[3][c[2]], I = r[3][c[3]], I4 = r[3][c[4]];
+            const uint32_t G5 = r[4][c[1]], H5 = r[4][c[2]], I5 = r[4][c[3]];
+
+            // top left, top right, bottom left, bottom right
+            uint32_t e[4] = { E, E, E, E };
+            xbr_corner(E, I, H, F, G, C, D, B, F4, I4, H5, I5, e[1], e[2], e[3]);
+            xbr_corner(E, C, F, B, I, A, H, D, B1, C1, F4, C4, e[0], e[3], e[1]);
+            xbr_corner(E, A, B, D, C, G, F, H, D0, A0, B1, A1, e[2], e[1], e[0]);
+            xbr_corner(E, G, D, H, A, I, B, F, H5, G5, D0, G0, e[3], e[0], e[2]);
+
+            uint32_t* o = out + x * 2;
+            o[0] = e[0];
+            o[1] = e[1];
+            o[pitch] = e[2];
+            o[pitch + 1] = e[3];
+        }
+    }
+}
+
+} // end namespace
+
+bool yb::parse_filter(const std::string& name, yb::Filter& filter)
+{
+    static const struct {
+        const char* name;
+        yb::Filter filter;
+    } FILTERS[] = {
+        { "nearest", yb::Filter::NEAREST },
+        { "scale2x", yb::Filter::SCALE2X },
+        { "scale3x", yb::Filter::SCALE3X },
+        { "xbr2x", yb::Filter::XBR2X },
+        { "xbr4x", yb::Filter::XBR4X },
+    };
+
+    for (const auto& entry : FILTERS) {
+        if (name == entry.name) {
+            filter = entry.filter;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+yb::Scaler::Scaler(yb::Filter filter, int factor, int width, int height, size_t threads)
+    : filter_(filter)
+    , factor_(fixed_factor(filter, factor))
+    , width_(width)
+    , height_(height)
+    , pool_(threads != 0 ? threads : default_threads())
+{
+    if (filter_ == yb::Filter::XBR4X) {
+        intermediate_.resize(width_ * 2 * height_ * 2);
+    }
+}
+
+int yb::Scaler::factor() const
+{
+    return factor_;
+}
+
+int yb::Scaler::outputWidth() const
+{
+    return width_ * factor_;
+}
+
+int yb::Scaler::outputHeight() const
+{
+    return height_ * factor_;
+}
+
+void yb::Scaler::scale(const uint32_t* src, uint32_t* dst)
+{
+    switch (filter_) {
+    case yb::Filter::NEAREST:
+        if (factor_ == 1) {
+            std::memcpy(dst, src, width_ * height_ * sizeof(uint32_t));
+        } else {
+            run(nearest, src, width_, height_, factor_, dst);
+        }
+        break;
+    case yb::Filter::SCALE2X:
+        run(scale2x, src, width_, height_, 2, dst);
+        break;
+    case yb::Filter::SCALE3X:
+        run(scale3x, src, width_, height_, 3, dst);
+        break;
+    case yb::Filter::XBR2X:
+        run(xbr2x, src, width_, height_, 2, dst);
+        break;
+    case yb::Filter::XBR4X:
+        run(xbr2x, src, width_, height_, 2, intermediate_.data());
+        run(xbr2x, intermediate_.data(), width_ * 2, height_ * 2, 2, dst);
+        break;
+    }
+}
+
+void yb::Scaler::run(Kernel kernel, const uint32_t* src, int width, int height, int factor, uint32_t* dst)
+{
+    // a few bands per thread so that stealing evens out uneven rows
+    const int bands = std::min<int>(height, (int) pool_.size() * 4);
+    for (int band = 0; band < bands; ++band) {
+        const int first = height * band / bands;
+        const int last = height * (band + 1) / bands;
+        pool_.submit([=] { kernel(src, width, height, factor, dst, first, last); });
+    }
+
+    pool_.wait();
+}
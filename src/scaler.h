@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace yb {
+
+    enum class Filter {
+        // Integer pixel replication by any factor.
+        NEAREST,
+        // AdvMAME2x/3x: edge-directed replication that keeps the palette.
+        SCALE2X,
+        SCALE3X,
+        // Hyllian's 2xBR, blending along detected edges; XBR4X runs it twice.
+        XBR2X,
+        XBR4X
+    };
+
+    // Parses "nearest", "scale2x", "scale3x", "xbr2x" or "xbr4x".
+    bool parse_filter(const std::string& name, yb::Filter& filter);
+
+    // Upscales ARGB8888 frames. The output is split into bands of rows that
+    // are filtered in parallel on the scaler's own threads, so an expensive
+    // filter doesn't compete with emulation for its core.
+    class Scaler
+    {
+    public:
+        // factor is only used by NEAREST; the other filters have a fixed one.
+        // Zero threads picks a small pool based on the machine.
+        Scaler(yb::Filter filter, int factor, int width, int height, size_t threads = 0);
+
+        int factor() const;
+        int outputWidth() const;
+        int outputHeight() const;
+
+        // Scales a width x height frame into dst, outputWidth() x outputHeight() pixels.
+        void scale(const uint32_t* src, uint32_t* dst);
+
+    private:
+        Scaler(const Scaler&) = delete;
+        Scaler& operator=(const Scaler&) = delete;
+
+        using Kernel = void (*)(const uint32_t* src, int width, int height, int factor,
+            uint32_t* dst, int first, int last);
+
+        // Runs one pass of a kernel over every source row, band by band.
+        void run(Kernel kernel, const uint32_t* src, int width, int height, int factor, uint32_t* dst);
+
+        yb::Filter filter_;
+        int factor_;
+        int width_;
+        int height_;
+
+        yb::ThreadPool pool_;
+
+        // Output of XBR4X's first pass.
+        std::vector<uint32_t> intermediate_;
+    };
+
+}
@@ -0,0 +1,80 @@
+#include "symbols.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "common.h"
+
+bool yb::SymbolTable::load(const char* path)
+{
+    std::FILE* file = std::fopen(path, "r");
+    if (!file) {
+        yb::error("Could not read symbol file %s.\n", path);
+        return false;
+    }
+
+    symbols_.clear();
+
+    char line[512];
+    while (std::fgets(line, sizeof(line), file)) {
+        line[std::strcspn(line, ";\r\n")] = '\0';
+
+        unsigned int bank = 0;
+        unsigned int addr = 0;
+        char name[256];
+        if (std::sscanf(line, "%x:%x %255s", &bank, &addr, name) == 3) {
+            symbols_.push_back(Symbol{ (bank & 0xFF) << 16 | (addr & 0xFFFF), name });
+        }
+    }
+    std::fclose(file);
+
+    std::stable_sort(symbols_.begin(), symbols_.end(), [](const Symbol& a, const Symbol& b) {
+        return a.location < b.location;
+    });
+
+    return true;
+}
+
+bool yb::SymbolTable::empty() const
+{
+    return symbols_.empty();
+}
+
+const char* yb::SymbolTable::lookup(uint8_t bank, uint16_t addr, uint16_t* offset) const
+{
+    const uint32_t location = (uint32_t) bank << 16 | addr;
+
+    auto next = std::upper_bound(symbols_.begin(), symbols_.end(), location, [](uint32_t l, const Symbol& s) {
+        return l < s.location;
+    });
+
+    // labels never reach across banks
+    if (next == symbols_.begin() || ((next - 1)->location >> 16) != bank) {
+        return nullptr;
+    }
+
+    const Symbol& symbol = *(next - 1);
+    if (offset) {
+        *offset = location - symbol.location;
+    }
+
+    return symbol.name.c_str();
+}
+
+std::string yb::SymbolTable::describe(uint8_t bank, uint16_t addr) const
+{
+    char text[300];
+
+    uint16_t offset = 0;
+    const char* name = lookup(bank, addr, &offset);
+    if (!name) {
+        std::snprintf(text, sizeof(text), "%02X:%04X", bank, addr);
+    } else if (offset == 0) {
+        std::snprintf(text, sizeof(text), "%s", name);
+    } else {
+        std::snprintf(text, sizeof(text), "%s+%u", name, offset);
+    }
+
+    return text;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace yb {
+
+    // Labels from an RGBDS .sym file ("BB:AAAA Name" per line, ';' comments).
+    class SymbolTable
+    {
+    public:
+        bool load(const char* path);
+
+        bool empty() const;
+
+        // Returns the closest label at or before bank:addr, or nullptr if there is none.
+        // offset receives the distance from that label.
+        const char* lookup(uint8_t bank, uint16_t addr, uint16_t* offset = nullptr) const;
+
+        // Returns the label's name followed by +offset when not exact, or BB:AAAA if none.
+        std::string describe(uint8_t bank, uint16_t addr) const;
+
+    private:
+        struct Symbol {
+            uint32_t location;
+            std::string name;
+        };
+
+        // sorted by location (bank << 16 | addr)
+        std::vector<Symbol> symbols_;
+    };
+
+}
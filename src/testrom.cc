@@ -0,0 +1,59 @@
+#include "testrom.h"
+
+const char* yb::to_string(TestVerdict verdict)
+{
+    switch (verdict) {
+    case TestVerdict::RUNNING:
+        return "running";
+    case TestVerdict::PASSED:
+        return "passed";
+    case TestVerdict::FAILED:
+        return "failed";
+    case TestVerdict::LOCKED:
+        return "locked";
+    case TestVerdict::TIMEOUT:
+        return "timeout";
+    }
+
+    return "unknown";
+}
+
+yb::TestVerdict yb::check_test_rom(const yb::Emulator& emulator)
+{
+    const std::string& serial = emulator.serial();
+    if (serial.find("Passed") != std::string::npos) {
+        return TestVerdict::PASSED;
+    }
+    if (serial.find("Failed") != std::string::npos) {
+        return TestVerdict::FAILED;
+    }
+
+    // mooneye ROMs spin forever after reporting, so registers are stable at frame boundaries
+    const yb::CPU& cpu = emulator.cpu();
+    if (cpu.BC.hi == 3 && cpu.BC.lo == 5 && cpu.DE.hi == 8 && cpu.DE.lo == 13 && cpu.HL.hi == 21 && cpu.HL.lo == 34) {
+        return TestVerdict::PASSED;
+    }
+    if (cpu.BC.value == 0x4242 && cpu.DE.value == 0x4242 && cpu.HL.value == 0x4242) {
+        return TestVerdict::FAILED;
+    }
+
+    if (emulator.isLocked()) {
+        return TestVerdict::LOCKED;
+    }
+
+    return TestVerdict::RUNNING;
+}
+
+yb::TestVerdict yb::run_test_rom(yb::Emulator& emulator, int maxFrames)
+{
+    for (int i = 0; i < maxFrames; ++i) {
+        emulator.runFrame();
+
+        const TestVerdict verdict = check_test_rom(emulator);
+        if (verdict != TestVerdict::RUNNING) {
+            return verdict;
+        }
+    }
+
+    return TestVerdict::TIMEOUT;
+}
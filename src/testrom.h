@@ -0,0 +1,27 @@
+#pragma once
+
+#include "emulator.h"
+
+namespace yb {
+
+    enum class TestVerdict
+    {
+        RUNNING = 0,
+        PASSED,
+        FAILED,
+        LOCKED,
+        TIMEOUT
+    };
+
+    const char* to_string(TestVerdict verdict);
+
+    // Looks for the result of a test ROM:
+    // - blargg ROMs print "Passed" or "Failed" over the serial port.
+    // - mooneye ROMs end on LD B,B with the Fibonacci numbers 3, 5, 8, 13, 21, 34
+    //   in B, C, D, E, H, L on success, or 0x42 in all of them on failure.
+    TestVerdict check_test_rom(const yb::Emulator& emulator);
+
+    // Runs a test ROM headlessly until it reports a result or maxFrames elapse.
+    TestVerdict run_test_rom(yb::Emulator& emulator, int maxFrames);
+
+}
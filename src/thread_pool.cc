@@ -0,0 +1,141 @@
+#include "thread_pool.h"
+
+namespace yb {
+
+// Identifies the pool and deque of the calling worker thread, if any.
+static thread_local const yb::ThreadPool* current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+} // end namespace
+
+yb::ThreadPool::ThreadPool(size_t threads)
+    : queued_(0)
+    , pending_(0)
+    , next_(0)
+    , stopping_(false)
+{
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        queues_.emplace_back(new Queue);
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+yb::ThreadPool::~ThreadPool()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    available_.notify_all();
+
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void yb::ThreadPool::submit(Task task)
+{
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_pool == this) {
+            index = current_index;
+        } else {
+            index = next_++ % queues_.size();
+        }
+        ++pending_;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++queued_;
+    }
+    available_.notify_one();
+}
+
+void yb::ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_.wait(lock, [this] { return pending_ == 0; });
+}
+
+size_t yb::ThreadPool::size() const
+{
+    return threads_.size();
+}
+
+void yb::ThreadPool::run(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            available_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+            if (queued_ == 0) {
+                return;
+            }
+            --queued_;
+        }
+
+        // A task is reserved for us, but another worker may be holding it
+        // between its own pop and steal attempts, so keep looking until found.
+        Task task;
+        while (!pop(index, task)) {
+            std::this_thread::yield();
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --pending_;
+            if (pending_ == 0) {
+                finished_.notify_all();
+            }
+        }
+    }
+}
+
+bool yb::ThreadPool::pop(size_t index, Task& task)
+{
+    {
+        Queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue& victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
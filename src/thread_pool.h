@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace yb {
+
+    // Work-stealing thread pool.
+    // Every worker owns a deque: it pops its own work from the back and, once
+    // that runs dry, steals from the front of the other workers' deques.
+    class ThreadPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        // Zero threads sizes the pool to the machine.
+        explicit ThreadPool(size_t threads = 0);
+        ~ThreadPool();
+
+        // Tasks submitted from a worker go to that worker's own deque.
+        void submit(Task task);
+
+        // Blocks until every submitted task has finished.
+        void wait();
+
+        size_t size() const;
+
+    private:
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void run(size_t index);
+
+        bool pop(size_t index, Task& task);
+
+        std::vector<std::unique_ptr<Queue>> queues_;
+        std::vector<std::thread> threads_;
+
+        std::mutex mutex_;
+        std::condition_variable available_;
+        std::condition_variable finished_;
+
+        size_t queued_;
+        size_t pending_;
+        size_t next_;
+        bool stopping_;
+    };
+}
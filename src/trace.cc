@@ -0,0 +1,606 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "common.h"
+#include "disasm.h"
+#include "savestate.h"
+
+namespace yb {
+
+static constexpr char MAGIC[4] = { 'Y', 'B', 'T', 'R' };
+static constexpr uint16_t VERSION = 1;
+static constexpr size_t HEADER_SIZE = 8;
+static constexpr size_t BLOCK_HEADER_SIZE = 8;
+
+// Token bytes: below ZERO_RUN, that many plus one literal bytes follow;
+// from ZERO_RUN up, a run of (token - ZERO_RUN + 1) zero bytes.
+static constexpr uint8_t ZERO_RUN = 0x80;
+static constexpr size_t MAX_RUN = 0x80;
+
+static void put16(uint8_t* out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static uint16_t get16(const uint8_t* in)
+{
+    return in[0] | in[1] << 8;
+}
+
+static bool is_zero64(const uint8_t* bytes)
+{
+    uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    return word == 0;
+}
+
+// Working buffers of the block codec, kept per thread so that blocks don't
+// pay for fresh allocations.
+struct Scratch {
+    std::vector<uint8_t> changes;
+    std::vector<uint8_t> residuals;
+    std::vector<uint8_t> columns;
+    std::vector<int32_t> follow;
+};
+
+static Scratch& thread_scratch(size_t size)
+{
+    static thread_local Scratch scratch;
+
+    scratch.changes.resize(size);
+    scratch.residuals.resize(size);
+    scratch.columns.resize(size);
+    scratch.follow.assign(0x10000, -1);
+
+    return scratch;
+}
+
+// Columns are count bytes apart, so transposing a tile of records at a time
+// keeps the column writes on whole cache lines.
+static constexpr size_t TILE = 64;
+
+static void to_columns(const uint8_t* rows, size_t count, uint8_t* columns)
+{
+    for (size_t first = 0; first < count; first += TILE) {
+        const size_t last = std::min(count, first + TILE);
+        for (size_t b = 0; b < TRACE_RECORD_SIZE; ++b) {
+            for (size_t i = first; i < last; ++i) {
+                columns[b * count + i] = rows[i * TRACE_RECORD_SIZE + b];
+            }
+        }
+    }
+}
+
+static void from_columns(const uint8_t* columns, size_t count, uint8_t* rows)
+{
+    for (size_t first = 0; first < count; first += TILE) {
+        const size_t last = std::min(count, first + TILE);
+        for (size_t b = 0; b < TRACE_RECORD_SIZE; ++b) {
+            for (size_t i = first; i < last; ++i) {
+                rows[i * TRACE_RECORD_SIZE + b] = columns[b * count + i];
+            }
+        }
+    }
+}
+
+static void xor_record(const uint8_t* a, const uint8_t* b, uint8_t* out)
+{
+    for (size_t i = 0; i < TRACE_RECORD_SIZE; i += 8) {
+        uint64_t x;
+        uint64_t y;
+        std::memcpy(&x, a + i, sizeof(x));
+        std::memcpy(&y, b + i, sizeof(y));
+        x ^= y;
+        std::memcpy(out + i, &x, sizeof(x));
+    }
+}
+
+// Turns an encoded record into the change from the previous one: the cycle
+// count and the 16 bit fields become differences, the instruction bytes stay.
+static void to_changes(const uint8_t* record, const uint8_t* previous, uint8_t* change)
+{
+    uint64_t cycle = 0;
+    uint64_t previousCycle = 0;
+    for (int i = 7; i >= 0; --i) {
+        cycle = cycle << 8 | record[i];
+        previousCycle = previousCycle << 8 | previous[i];
+    }
+
+    const uint64_t elapsed = cycle - previousCycle;
+    for (int i = 0; i < 8; ++i) {
+        change[i] = (uint8_t)(elapsed >> (i * 8));
+    }
+
+    for (int i = 8; i < 20; i += 2) {
+        put16(change + i, get16(record + i) - get16(previous + i));
+    }
+
+    std::memcpy(change + 20, record + 20, TRACE_RECORD_SIZE - 20);
+}
+
+static void from_changes(const uint8_t* change, const uint8_t* previous, uint8_t* record)
+{
+    uint64_t elapsed = 0;
+    uint64_t previousCycle = 0;
+    for (int i = 7; i >= 0; --i) {
+        elapsed = elapsed << 8 | change[i];
+        previousCycle = previousCycle << 8 | previous[i];
+    }
+
+    const uint64_t cycle = previousCycle + elapsed;
+    for (int i = 0; i < 8; ++i) {
+        record[i] = (uint8_t)(cycle >> (i * 8));
+    }
+
+    for (int i = 8; i < 20; i += 2) {
+        put16(record + i, get16(change + i) + get16(previous + i));
+    }
+
+    std::memcpy(record + 20, change + 20, TRACE_RECORD_SIZE - 20);
+}
+
+// Returns the record that followed the previous record's PC last time it
+// was seen, or -1, and remembers that record index now follows it.
+// Loops make that record an excellent prediction of the current one.
+static int32_t predict(std::vector<int32_t>& follow, const uint8_t* previous, int32_t index)
+{
+    if (index == 0) {
+        return -1;
+    }
+
+    int32_t& slot = follow[get16(previous + 8)];
+    const int32_t ref = slot;
+    slot = index;
+
+    return ref;
+}
+
+} // end namespace
+
+yb::TraceRecord yb::make_trace_record(const yb::CPU& cpu, const yb::Step& step)
+{
+    yb::TraceRecord record;
+    record.cycle = step.cycle;
+    record.pc = step.pc;
+    record.af = cpu.AF.value;
+    record.bc = cpu.BC.value;
+    record.de = cpu.DE.value;
+    record.hl = cpu.HL.value;
+    record.sp = cpu.SP.value;
+    record.bank = step.bank;
+    record.op = step.op;
+    record.operands[0] = step.operands[0];
+    record.operands[1] = step.operands[1];
+
+    return record;
+}
+
+void yb::encode_trace_record(const yb::TraceRecord& record, uint8_t* out)
+{
+    for (int i = 0; i < 8; ++i) {
+        out[i] = (uint8_t)(record.cycle >> (i * 8));
+    }
+    put16(out + 8, record.pc);
+    put16(out + 10, record.af);
+    put16(out + 12, record.bc);
+    put16(out + 14, record.de);
+    put16(out + 16, record.hl);
+    put16(out + 18, record.sp);
+    out[20] = record.bank;
+    out[21] = record.op;
+    out[22] = record.operands[0];
+    out[23] = record.operands[1];
+}
+
+yb::TraceRecord yb::decode_trace_record(const uint8_t* in)
+{
+    yb::TraceRecord record;
+
+    record.cycle = 0;
+    for (int i = 0; i < 8; ++i) {
+        record.cycle |= (uint64_t) in[i] << (i * 8);
+    }
+    record.pc = get16(in + 8);
+    record.af = get16(in + 10);
+    record.bc = get16(in + 12);
+    record.de = get16(in + 14);
+    record.hl = get16(in + 16);
+    record.sp = get16(in + 18);
+    record.bank = in[20];
+    record.op = in[21];
+    record.operands[0] = in[22];
+    record.operands[1] = in[23];
+
+    return record;
+}
+
+bool yb::same_trace_record(const yb::TraceRecord& a, const yb::TraceRecord& b)
+{
+    uint8_t encodedA[TRACE_RECORD_SIZE];
+    uint8_t encodedB[TRACE_RECORD_SIZE];
+    encode_trace_record(a, encodedA);
+    encode_trace_record(b, encodedB);
+
+    return std::memcmp(encodedA, encodedB, TRACE_RECORD_SIZE) == 0;
+}
+
+std::string yb::format_trace_record(const yb::TraceRecord& record)
+{
+    const uint8_t bytes[3] = { record.op, record.operands[0], record.operands[1] };
+    std::string text;
+    yb::disassemble(record.pc, bytes, text);
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "%12llu %02X:%04X  %02X %02X %02X  %-16s AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X",
+        (unsigned long long) record.cycle, record.bank, record.pc, bytes[0], bytes[1], bytes[2], text.c_str(),
+        record.af, record.bc, record.de, record.hl, record.sp);
+
+    return line;
+}
+
+void yb::compress_trace_block(const uint8_t* records, size_t count, std::vector<uint8_t>& out)
+{
+    const size_t size = count * TRACE_RECORD_SIZE;
+
+    Scratch& scratch = thread_scratch(size);
+    std::vector<uint8_t>& changes = scratch.changes;
+    std::vector<uint8_t>& residuals = scratch.residuals;
+    std::vector<int32_t>& follow = scratch.follow;
+
+    uint8_t previous[TRACE_RECORD_SIZE] = {};
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* record = records + i * TRACE_RECORD_SIZE;
+        uint8_t* change = changes.data() + i * TRACE_RECORD_SIZE;
+        to_changes(record, previous, change);
+
+        // what this instruction did, relative to what the instruction after
+        // the same PC did last time
+        const int32_t ref = predict(follow, previous, (int32_t) i);
+        uint8_t* residual = residuals.data() + i * TRACE_RECORD_SIZE;
+        if (ref >= 0) {
+            xor_record(change, changes.data() + ref * TRACE_RECORD_SIZE, residual);
+        } else {
+            std::memcpy(residual, change, TRACE_RECORD_SIZE);
+        }
+
+        std::memcpy(previous, record, TRACE_RECORD_SIZE);
+    }
+
+    std::vector<uint8_t>& columns = scratch.columns;
+    to_columns(residuals.data(), count, columns.data());
+
+    // worst case: one token per MAX_RUN literal bytes
+    out.resize(size + size / MAX_RUN + 1);
+    uint8_t* token = out.data();
+
+    const uint8_t* column = columns.data();
+    const uint8_t* end = column + size;
+    while (column < end) {
+        const uint8_t* runEnd = column + std::min<size_t>(MAX_RUN, end - column);
+        const uint8_t* run = column;
+
+        if (*run == 0) {
+            // nearly everything is zero: skip it a word at a time
+            while (run + 8 <= runEnd && is_zero64(run)) {
+                run += 8;
+            }
+            while (run < runEnd && *run == 0) {
+                ++run;
+            }
+            *token++ = (uint8_t)(ZERO_RUN + (run - column) - 1);
+        } else {
+            // a lone zero is cheaper to keep inside the literal
+            while (run < runEnd && !(run[0] == 0 && run + 1 < end && run[1] == 0)) {
+                ++run;
+            }
+            *token++ = (uint8_t)((run - column) - 1);
+            std::memcpy(token, column, run - column);
+            token += run - column;
+        }
+        column = run;
+    }
+
+    out.resize(token - out.data());
+}
+
+bool yb::decompress_trace_block(const uint8_t* data, size_t size, size_t count, std::vector<uint8_t>& records)
+{
+    const size_t expected = count * TRACE_RECORD_SIZE;
+
+    Scratch& scratch = thread_scratch(expected);
+    std::vector<uint8_t>& columns = scratch.columns;
+    uint8_t* column = columns.data();
+    const uint8_t* columnsEnd = column + expected;
+
+    const uint8_t* token = data;
+    const uint8_t* end = data + size;
+    while (token < end) {
+        const size_t run = (*token & (ZERO_RUN - 1)) + 1;
+        if (run > (size_t)(columnsEnd - column)) {
+            return false;
+        }
+
+        if (*token++ >= ZERO_RUN) {
+            std::memset(column, 0, run);
+        } else {
+            if (run > (size_t)(end - token)) {
+                return false;
+            }
+            std::memcpy(column, token, run);
+            token += run;
+        }
+        column += run;
+    }
+
+    if (column != columnsEnd) {
+        return false;
+    }
+
+    std::vector<uint8_t>& residuals = scratch.residuals;
+    from_columns(columns.data(), count, residuals.data());
+
+    std::vector<uint8_t>& changes = scratch.changes;
+    std::vector<int32_t>& follow = scratch.follow;
+    records.resize(expected);
+
+    uint8_t previous[TRACE_RECORD_SIZE] = {};
+    for (size_t j = 0; j < count; ++j) {
+        const int32_t ref = predict(follow, previous, (int32_t) j);
+        const uint8_t* residual = residuals.data() + j * TRACE_RECORD_SIZE;
+        uint8_t* change = changes.data() + j * TRACE_RECORD_SIZE;
+        if (ref >= 0) {
+            xor_record(residual, changes.data() + ref * TRACE_RECORD_SIZE, change);
+        } else {
+            std::memcpy(change, residual, TRACE_RECORD_SIZE);
+        }
+
+        uint8_t* record = records.data() + j * TRACE_RECORD_SIZE;
+        from_changes(change, previous, record);
+        std::memcpy(previous, record, TRACE_RECORD_SIZE);
+    }
+
+    return true;
+}
+
+yb::TraceWriter::TraceWriter()
+    : file_(nullptr)
+    , fill_(0)
+    , records_(0)
+    , buffers_(1)
+    , closing_(false)
+    , failed_(false)
+{}
+
+yb::TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool yb::TraceWriter::open(const char* path)
+{
+    file_ = std::fopen(path, "wb");
+    if (!file_) {
+        yb::error("Could not write %s.\n", path);
+        return false;
+    }
+
+    std::vector<uint8_t> header;
+    yb::StateWriter writer(header);
+    writer.writeBytes(MAGIC, sizeof(MAGIC));
+    writer.write16(VERSION);
+    writer.write16((uint16_t) TRACE_RECORD_SIZE);
+
+    if (std::fwrite(header.data(), 1, header.size(), file_) != header.size()) {
+        yb::error("Could not write %s.\n", path);
+        std::fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+
+    block_.resize(BLOCK_RECORDS * TRACE_RECORD_SIZE);
+    thread_ = std::thread(&TraceWriter::run, this);
+
+    return true;
+}
+
+bool yb::TraceWriter::close()
+{
+    if (!file_) {
+        return !failed_;
+    }
+
+    if (fill_ > 0) {
+        submit();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+
+    if (std::fclose(file_) != 0) {
+        failed_ = true;
+    }
+    file_ = nullptr;
+
+    return !failed_;
+}
+
+uint64_t yb::TraceWriter::records() const
+{
+    return records_;
+}
+
+void yb::TraceWriter::onInstruction(const yb::CPU& cpu, const yb::Step& step)
+{
+    encode_trace_record(make_trace_record(cpu, step), block_.data() + fill_ * TRACE_RECORD_SIZE);
+    ++records_;
+
+    if (++fill_ == BLOCK_RECORDS) {
+        submit();
+    }
+}
+
+// Hands the current block to the writer and takes a free buffer in its place.
+void yb::TraceWriter::submit()
+{
+    block_.resize(fill_ * TRACE_RECORD_SIZE);
+    fill_ = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    full_.push_back(std::move(block_));
+    changed_.notify_all();
+
+    if (free_.empty() && buffers_ < MAX_BUFFERS) {
+        ++buffers_;
+        block_.clear();
+    } else {
+        changed_.wait(lock, [this] { return !free_.empty(); });
+        block_ = std::move(free_.back());
+        free_.pop_back();
+    }
+    lock.unlock();
+
+    block_.resize(BLOCK_RECORDS * TRACE_RECORD_SIZE);
+}
+
+void yb::TraceWriter::run()
+{
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> header;
+
+    for (;;) {
+        std::vector<uint8_t> block;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this] { return !full_.empty() || closing_; });
+            if (full_.empty()) {
+                return;
+            }
+            block = std::move(full_.front());
+            full_.pop_front();
+        }
+
+        const size_t count = block.size() / TRACE_RECORD_SIZE;
+        compress_trace_block(block.data(), count, compressed);
+
+        header.clear();
+        yb::StateWriter writer(header);
+        writer.write32((uint32_t) count);
+        writer.write32((uint32_t) compressed.size());
+
+        const bool written =
+            std::fwrite(header.data(), 1, header.size(), file_) == header.size() &&
+            std::fwrite(compressed.data(), 1, compressed.size(), file_) == compressed.size();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!written && !failed_) {
+            yb::error("Could not write the trace: the disk may be full.\n");
+            failed_ = true;
+        }
+        free_.push_back(std::move(block));
+        changed_.notify_all();
+    }
+}
+
+yb::TraceReader::TraceReader()
+    : file_(nullptr)
+    , count_(0)
+    , pos_(0)
+    , ok_(true)
+{}
+
+yb::TraceReader::~TraceReader()
+{
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+bool yb::TraceReader::open(const char* path)
+{
+    file_ = std::fopen(path, "rb");
+    if (!file_) {
+        yb::error("Could not read %s.\n", path);
+        return false;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    if (std::fread(header, 1, sizeof(header), file_) != sizeof(header)) {
+        yb::error("%s is not a trace file.\n", path);
+        return false;
+    }
+
+    yb::StateReader reader(header, sizeof(header));
+    char magic[sizeof(MAGIC)];
+    reader.readBytes(magic, sizeof(magic));
+    const uint16_t version = reader.read16();
+    const uint16_t recordSize = reader.read16();
+
+    if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        yb::error("%s is not a trace file.\n", path);
+        return false;
+    }
+    if (version != VERSION || recordSize != TRACE_RECORD_SIZE) {
+        yb::error("%s is a version %u trace; only version %u is supported.\n", path, version, VERSION);
+        return false;
+    }
+
+    return true;
+}
+
+bool yb::TraceReader::next(yb::TraceRecord& record)
+{
+    if (pos_ == count_ && !readBlock()) {
+        return false;
+    }
+
+    record = decode_trace_record(block_.data() + pos_ * TRACE_RECORD_SIZE);
+    ++pos_;
+
+    return true;
+}
+
+bool yb::TraceReader::ok() const
+{
+    return ok_;
+}
+
+bool yb::TraceReader::readBlock()
+{
+    if (!file_ || !ok_) {
+        return false;
+    }
+
+    uint8_t header[BLOCK_HEADER_SIZE];
+    const size_t n = std::fread(header, 1, sizeof(header), file_);
+    if (n == 0) {
+        return false;
+    }
+
+    yb::StateReader reader(header, n);
+    const uint32_t count = reader.read32();
+    const uint32_t size = reader.read32();
+
+    // an empty block would end the trace early, so it counts as damage too
+    ok_ = reader.ok() && count != 0 && count <= yb::TraceWriter::BLOCK_RECORDS;
+    if (ok_) {
+        compressed_.resize(size);
+        ok_ = std::fread(compressed_.data(), 1, size, file_) == size &&
+              decompress_trace_block(compressed_.data(), size, count, block_);
+    }
+
+    if (!ok_) {
+        yb::error("The trace is damaged.\n");
+        return false;
+    }
+
+    count_ = count;
+    pos_ = 0;
+    return true;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hook.h"
+
+namespace yb {
+
+    // One executed instruction. Registers hold the state after it ran.
+    struct TraceRecord {
+        uint64_t cycle;
+        uint16_t pc;
+        uint16_t af;
+        uint16_t bc;
+        uint16_t de;
+        uint16_t hl;
+        uint16_t sp;
+        uint8_t bank;
+        uint8_t op;
+        uint8_t operands[2];
+    };
+
+    // Records are stored as fixed-width little endian fields, in the order declared.
+    static constexpr size_t TRACE_RECORD_SIZE = 24;
+
+    yb::TraceRecord make_trace_record(const yb::CPU& cpu, const yb::Step& step);
+
+    void encode_trace_record(const yb::TraceRecord& record, uint8_t* out);
+    yb::TraceRecord decode_trace_record(const uint8_t* in);
+
+    bool same_trace_record(const yb::TraceRecord& a, const yb::TraceRecord& b);
+
+    // One line of text: cycle, bank:PC, the three bytes fetched at PC, disassembly
+    // and registers.
+    std::string format_trace_record(const yb::TraceRecord& record);
+
+    // Trace files hold a header followed by independently compressed blocks of
+    // records. Each record is reduced to the change its instruction made (cycles
+    // taken, register and PC differences, instruction bytes) and XORed with the
+    // change made the last time execution passed the same spot, which in loops
+    // is usually identical. The result is stored column by column as zero runs
+    // and literal runs.
+    void compress_trace_block(const uint8_t* records, size_t count, std::vector<uint8_t>& out);
+    bool decompress_trace_block(const uint8_t* data, size_t size, size_t count, std::vector<uint8_t>& records);
+
+    // Streams every executed instruction to a trace file.
+    //
+    // Records are appended to a block buffer owned by the recorder, so the
+    // emulation thread never locks per instruction; full blocks go to a writer
+    // thread that compresses and writes them. When the writer falls behind the
+    // emulation waits for a free buffer rather than dropping records.
+    class TraceWriter : public yb::InstructionHook
+    {
+    public:
+        static constexpr size_t BLOCK_RECORDS = 1 << 16;
+
+        TraceWriter();
+        ~TraceWriter();
+
+        bool open(const char* path);
+
+        // Flushes the remaining records and waits for the writer.
+        // Returns false if anything failed to reach the file.
+        bool close();
+
+        uint64_t records() const;
+
+        void onInstruction(const yb::CPU& cpu, const yb::Step& step) override;
+
+    private:
+        TraceWriter(const TraceWriter&) = delete;
+        TraceWriter& operator=(const TraceWriter&) = delete;
+
+        static constexpr size_t MAX_BUFFERS = 4;
+
+        void submit();
+        void run();
+
+        std::FILE* file_;
+        std::thread thread_;
+
+        std::vector<uint8_t> block_;
+        size_t fill_;
+        uint64_t records_;
+
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::deque<std::vector<uint8_t>> full_;
+        std::vector<std::vector<uint8_t>> free_;
+        size_t buffers_;
+        bool closing_;
+        bool failed_;
+    };
+
+    // Reads records back from a trace file.
+    class TraceReader
+    {
+    public:
+        TraceReader();
+        ~TraceReader();
+
+        bool open(const char* path);
+
+        // Returns false at the end of the trace or on a damaged file; ok()
+        // tells the two apart.
+        bool next(yb::TraceRecord& record);
+
+        bool ok() const;
+
+    private:
+        TraceReader(const TraceReader&) = delete;
+        TraceReader& operator=(const TraceReader&) = delete;
+
+        bool readBlock();
+
+        std::FILE* file_;
+        std::vector<uint8_t> compressed_;
+        std::vector<uint8_t> block_;
+        size_t count_;
+        size_t pos_;
+        bool ok_;
+    };
+
+}
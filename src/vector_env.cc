@@ -0,0 +1,144 @@
+#include "vector_env.h"
+
+#include <algorithm>
+
+#include "ppu.h"
+
+namespace yb {
+
+// JFIF luma weights in 16.16 fixed point, as the video recorder uses.
+static uint32_t luma(uint32_t argb)
+{
+    const uint32_t r = (argb >> 16) & 0xFF;
+    const uint32_t g = (argb >> 8) & 0xFF;
+    const uint32_t b = argb & 0xFF;
+
+    return (19595 * r + 38470 * g + 7471 * b + 0x8000) >> 16;
+}
+
+// Averages every factor x factor box of the framebuffer into one pixel of out.
+static void write_frame(const uint32_t* pixels, yb::FrameFormat format, int factor, uint8_t* out)
+{
+    const int width = YB_SCREEN_WIDTH / factor;
+    const int height = YB_SCREEN_HEIGHT / factor;
+    const uint32_t area = factor * factor;
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const uint32_t* box = pixels + (y * factor) * YB_SCREEN_WIDTH + x * factor;
+
+            uint32_t r = 0;
+            uint32_t g = 0;
+            uint32_t b = 0;
+            uint32_t grey = 0;
+            for (int by = 0; by < factor; ++by) {
+                for (int bx = 0; bx < factor; ++bx) {
+                    const uint32_t pixel = box[by * YB_SCREEN_WIDTH + bx];
+                    if (format == yb::FrameFormat::GRAY8) {
+                        grey += luma(pixel);
+                    } else {
+                        r += (pixel >> 16) & 0xFF;
+                        g += (pixel >> 8) & 0xFF;
+                        b += pixel & 0xFF;
+                    }
+                }
+            }
+
+            if (format == yb::FrameFormat::GRAY8) {
+                out[y * width + x] = (uint8_t)((grey + area / 2) / area);
+            } else {
+                const uint32_t argb = 0xFF000000
+                    | ((r + area / 2) / area) << 16
+                    | ((g + area / 2) / area) << 8
+                    | ((b + area / 2) / area);
+                reinterpret_cast<uint32_t*>(out)[y * width + x] = argb;
+            }
+        }
+    }
+}
+
+} // end namespace
+
+yb::VectorEnv::VectorEnv(const yb::Cartridge& cartridge, size_t count, size_t threads)
+    : frames_(count, 0)
+    , pool_(threads)
+{
+    machines_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        machines_.emplace_back(new yb::Emulator(cartridge, true));
+    }
+
+    if (count > 0) {
+        machines_[0]->saveState(powerOn_);
+    }
+}
+
+size_t yb::VectorEnv::size() const
+{
+    return machines_.size();
+}
+
+size_t yb::VectorEnv::frameSize(yb::FrameFormat format, int downscale)
+{
+    if (downscale != 1 && downscale != 2 && downscale != 4) {
+        return 0;
+    }
+
+    const size_t pixels = (YB_SCREEN_WIDTH / downscale) * (YB_SCREEN_HEIGHT / downscale);
+    return format == yb::FrameFormat::GRAY8 ? pixels : pixels * sizeof(uint32_t);
+}
+
+// Machines are handed out in a few bands per thread, so that stealing evens
+// out machines whose frames cost more than others.
+bool yb::VectorEnv::step(const uint8_t* inputs, void* frames, yb::FrameFormat format, int downscale)
+{
+    const size_t frameSize = VectorEnv::frameSize(format, downscale);
+    if (frameSize == 0) {
+        return false;
+    }
+
+    const size_t count = machines_.size();
+    const size_t bands = std::min(count, pool_.size() * 4);
+    uint8_t* out = static_cast<uint8_t*>(frames);
+
+    for (size_t band = 0; band < bands; ++band) {
+        const size_t first = count * band / bands;
+        const size_t last = count * (band + 1) / bands;
+        pool_.submit([=] {
+            for (size_t i = first; i < last; ++i) {
+                yb::Emulator& machine = *machines_[i];
+                machine.setInput(inputs ? inputs[i] : 0);
+                machine.runFrame();
+                ++frames_[i];
+
+                if (out) {
+                    write_frame(machine.framebuffer(), format, downscale, out + i * frameSize);
+                }
+            }
+        });
+    }
+
+    pool_.wait();
+    return true;
+}
+
+uint64_t yb::VectorEnv::frames(size_t i) const
+{
+    return frames_[i];
+}
+
+void yb::VectorEnv::reset(size_t i)
+{
+    machines_[i]->loadState(powerOn_.data(), powerOn_.size());
+    frames_[i] = 0;
+}
+
+yb::Emulator& yb::VectorEnv::machine(size_t i)
+{
+    return *machines_[i];
+}
+
+const yb::Emulator& yb::VectorEnv::machine(size_t i) const
+{
+    return *machines_[i];
+}
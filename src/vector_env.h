@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cartridge.h"
+#include "emulator.h"
+#include "thread_pool.h"
+
+namespace yb {
+
+    enum class FrameFormat {
+        // 4 bytes a pixel, like the framebuffer
+        ARGB8888,
+        // 1 byte of full range BT.601 luma a pixel
+        GRAY8
+    };
+
+    // Many headless machines running one ROM, stepped a frame at a time
+    // together: one call sets every machine's buttons, runs them all on a
+    // thread pool and writes every frame into one contiguous buffer, machine
+    // after machine, each optionally shrunk by averaging boxes of 2x2 or 4x4
+    // pixels and converted to grey. Whatever the environment tracks per
+    // machine is kept in arrays indexed by machine rather than next to it.
+    class VectorEnv
+    {
+    public:
+        // Zero threads sizes the pool to the machine.
+        VectorEnv(const yb::Cartridge& cartridge, size_t count, size_t threads = 0);
+
+        size_t size() const;
+
+        // Bytes one machine's frame takes in step's output, 0 if downscale
+        // isn't 1, 2 or 4.
+        static size_t frameSize(yb::FrameFormat format, int downscale);
+
+        // Runs machine i for a frame holding inputs[i] (see yb::Button), for
+        // every machine. frames, if not null, receives size() frames of
+        // frameSize(format, downscale) bytes. Returns false without running
+        // anything for an invalid downscale.
+        bool step(const uint8_t* inputs, void* frames, yb::FrameFormat format, int downscale);
+
+        // Frames machine i has run since it was created or reset.
+        uint64_t frames(size_t i) const;
+
+        // Puts machine i back into its power on state.
+        void reset(size_t i);
+
+        yb::Emulator& machine(size_t i);
+        const yb::Emulator& machine(size_t i) const;
+
+    private:
+        VectorEnv(const VectorEnv&) = delete;
+        VectorEnv& operator=(const VectorEnv&) = delete;
+
+        std::vector<std::unique_ptr<yb::Emulator>> machines_;
+        std::vector<uint64_t> frames_;
+        // every machine starts from the same state
+        std::vector<uint8_t> powerOn_;
+        yb::ThreadPool pool_;
+    };
+
+}
@@ -0,0 +1,159 @@
+#include "video.h"
+
+#include <cstring>
+
+#include "common.h"
+
+namespace yb {
+
+static constexpr size_t FRAME_PIXELS = YB_SCREEN_WIDTH * YB_SCREEN_HEIGHT;
+
+// JFIF (full range BT.601) coefficients in 16.16 fixed point. Each row of the
+// chroma weights sums to zero and the luma weights to one, so greys convert exactly.
+static void argb_to_ycbcr(const uint32_t* pixels, uint8_t* planes)
+{
+    uint8_t* y = planes;
+    uint8_t* cb = planes + FRAME_PIXELS;
+    uint8_t* cr = planes + 2 * FRAME_PIXELS;
+
+    for (size_t i = 0; i < FRAME_PIXELS; ++i) {
+        const int32_t r = (pixels[i] >> 16) & 0xFF;
+        const int32_t g = (pixels[i] >> 8) & 0xFF;
+        const int32_t b = pixels[i] & 0xFF;
+
+        y[i] = (uint8_t)((19595 * r + 38470 * g + 7471 * b + 0x8000) >> 16);
+        cb[i] = (uint8_t)((-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 0x8000) >> 16);
+        cr[i] = (uint8_t)((32768 * r - 27439 * g - 5329 * b + (128 << 16) + 0x8000) >> 16);
+    }
+}
+
+} // end namespace
+
+yb::VideoRecorder::VideoRecorder(yb::Emulator* emulator)
+    : emulator_(emulator)
+    , file_(nullptr)
+    , frames_(0)
+    , dropped_(0)
+    , buffers_(0)
+    , closing_(false)
+    , failed_(false)
+{}
+
+yb::VideoRecorder::~VideoRecorder()
+{
+    close();
+}
+
+bool yb::VideoRecorder::open(const char* path)
+{
+    file_ = std::fopen(path, "wb");
+    if (!file_) {
+        yb::error("Could not write %s.\n", path);
+        return false;
+    }
+
+    // 4194304 / 70224 frames per second, reduced
+    const int written = std::fprintf(file_, "YUV4MPEG2 W%d H%d F262144:4389 Ip A1:1 C444 XCOLORRANGE=FULL\n",
+        YB_SCREEN_WIDTH, YB_SCREEN_HEIGHT);
+    if (written < 0) {
+        yb::error("Could not write %s.\n", path);
+        std::fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+
+    thread_ = std::thread(&VideoRecorder::run, this);
+    emulator_->addFrameHook(this);
+
+    return true;
+}
+
+bool yb::VideoRecorder::close()
+{
+    if (!file_) {
+        return !failed_;
+    }
+
+    emulator_->removeFrameHook(this);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+
+    if (std::fclose(file_) != 0) {
+        failed_ = true;
+    }
+    file_ = nullptr;
+
+    return !failed_;
+}
+
+uint64_t yb::VideoRecorder::frames() const
+{
+    return frames_;
+}
+
+uint64_t yb::VideoRecorder::dropped() const
+{
+    return dropped_;
+}
+
+void yb::VideoRecorder::onFrame()
+{
+    std::vector<uint32_t> frame;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            frame = std::move(free_.back());
+            free_.pop_back();
+        } else if (buffers_ < MAX_BUFFERS) {
+            ++buffers_;
+        } else {
+            ++dropped_;
+            return;
+        }
+    }
+
+    frame.resize(FRAME_PIXELS);
+    std::memcpy(frame.data(), emulator_->framebuffer(), FRAME_PIXELS * sizeof(uint32_t));
+    ++frames_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    full_.push_back(std::move(frame));
+    changed_.notify_all();
+}
+
+void yb::VideoRecorder::run()
+{
+    static const char FRAME_HEADER[] = "FRAME\n";
+    std::vector<uint8_t> planes(3 * FRAME_PIXELS);
+
+    for (;;) {
+        std::vector<uint32_t> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this] { return !full_.empty() || closing_; });
+            if (full_.empty()) {
+                return;
+            }
+            frame = std::move(full_.front());
+            full_.pop_front();
+        }
+
+        argb_to_ycbcr(frame.data(), planes.data());
+
+        const bool written =
+            std::fwrite(FRAME_HEADER, 1, sizeof(FRAME_HEADER) - 1, file_) == sizeof(FRAME_HEADER) - 1 &&
+            std::fwrite(planes.data(), 1, planes.size(), file_) == planes.size();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!written && !failed_) {
+            yb::error("Could not write the recording: the disk may be full.\n");
+            failed_ = true;
+        }
+        free_.push_back(std::move(frame));
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "emulator.h"
+#include "hook.h"
+
+namespace yb {
+
+    // Records every emulated frame to a YUV4MPEG2 (.y4m) file.
+    //
+    // Frames are copied into a small pool of buffers and converted and written
+    // on a background thread. The emulation thread never waits for the disk:
+    // when every buffer is still queued the frame is dropped and counted.
+    // Frames are stored as full range 4:4:4 YCbCr, which is exact for the DMG's
+    // grey shades.
+    class VideoRecorder : public yb::FrameHook
+    {
+    public:
+        // The emulator is not owned; the recorder installs itself on it once open.
+        explicit VideoRecorder(yb::Emulator* emulator);
+        ~VideoRecorder();
+
+        bool open(const char* path);
+
+        // Writes the queued frames and waits for the writer.
+        // Returns false if anything failed to reach the file.
+        bool close();
+
+        uint64_t frames() const;
+        uint64_t dropped() const;
+
+        void onFrame() override;
+
+    private:
+        VideoRecorder(const VideoRecorder&) = delete;
+        VideoRecorder& operator=(const VideoRecorder&) = delete;
+
+        static constexpr size_t MAX_BUFFERS = 16;
+
+        void run();
+
+        yb::Emulator* emulator_;
+        std::FILE* file_;
+        std::thread thread_;
+
+        uint64_t frames_;
+        uint64_t dropped_;
+
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::deque<std::vector<uint32_t>> full_;
+        std::vector<std::vector<uint32_t>> free_;
+        size_t buffers_;
+        bool closing_;
+        bool failed_;
+    };
+
+}
@@ -1,11 +1,40 @@
 #include "window.h"
 
 #include <SDL2/SDL.h>
+#include <algorithm>
 #include <cstdio>
 
+#include "joypad.h"
+
+// Filters read neighbouring source lines (xbr4x up to three away), so a
+// changed line also changes this many lines of output around it.
+static constexpr int FILTER_REACH = 3;
+
+// Arrows for the D-pad, X and Z for A and B, Enter for Start and
+// Backspace or right Shift for Select.
+static uint8_t button_for(SDL_Keycode key)
+{
+    switch (key) {
+    case SDLK_RIGHT:     return yb::BUTTON_RIGHT;
+    case SDLK_LEFT:      return yb::BUTTON_LEFT;
+    case SDLK_UP:        return yb::BUTTON_UP;
+    case SDLK_DOWN:      return yb::BUTTON_DOWN;
+    case SDLK_x:         return yb::BUTTON_A;
+    case SDLK_z:         return yb::BUTTON_B;
+    case SDLK_BACKSPACE: return yb::BUTTON_SELECT;
+    case SDLK_RSHIFT:    return yb::BUTTON_SELECT;
+    case SDLK_RETURN:    return yb::BUTTON_START;
+    default:             return 0;
+    }
+}
+
 // TODO: proper error handling
 yb::Window::Window(const char* title, int width, int height)
-    : isQuit_(false)
+    : width_(width)
+    , height_(height)
+    , redraw_(true)
+    , isQuit_(false)
+    , buttons_(0)
 {
     if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
         std::fputs("Unable to initialize SDL.", stderr);
@@ -17,7 +46,7 @@ yb::Window::Window(const char* title, int width, int height)
         SDL_WINDOWPOS_UNDEFINED,
         width,
         height,
-        SDL_WINDOW_SHOWN
+        SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
     );
 
     if (window_ == nullptr) {
@@ -30,18 +59,121 @@ yb::Window::Window(const char* title, int width, int height)
     SDL_FillRect(surface_, nullptr, SDL_MapRGB(surface_->format, 0xFF, 0xFF, 0xFF));
 }
 
-void yb::Window::draw()
+void yb::Window::draw(const uint32_t* pixels, const bool* dirtyLines)
 {
-    SDL_UpdateWindowSurface(window_);
+    if (dirtyLines && !redraw_ && std::find(dirtyLines, dirtyLines + height_, true) == dirtyLines + height_) {
+        return;
+    }
+
+    int width = width_;
+    int height = height_;
+    if (scaler_) {
+        scaler_->scale(pixels, scaled_.data());
+        pixels = scaled_.data();
+        width = scaler_->outputWidth();
+        height = scaler_->outputHeight();
+    }
+
+    SDL_Surface* frame = SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<uint32_t*>(pixels),
+        width,
+        height,
+        32,
+        width * sizeof(uint32_t),
+        SDL_PIXELFORMAT_ARGB8888
+    );
+
+    // largest rectangle with the frame's aspect ratio, centred
+    SDL_Rect target;
+    target.w = std::min(surface_->w, surface_->h * width / height);
+    target.h = std::min(surface_->h, surface_->w * height / width);
+    target.x = (surface_->w - target.w) / 2;
+    target.y = (surface_->h - target.h) / 2;
+
+    if (target.w == width && target.h == height && target.x == 0 && target.y == 0) {
+        SDL_BlitSurface(frame, nullptr, surface_, nullptr);
+    } else {
+        if (redraw_) {
+            SDL_FillRect(surface_, nullptr, SDL_MapRGB(surface_->format, 0, 0, 0));
+        }
+        SDL_BlitScaled(frame, nullptr, surface_, &target);
+    }
+    SDL_FreeSurface(frame);
+
+    if (!dirtyLines || redraw_) {
+        SDL_UpdateWindowSurface(window_);
+        redraw_ = false;
+        return;
+    }
+
+    // one rectangle per run of dirty lines, widened by the filter's reach
+    // and merged with the previous one where they meet
+    std::vector<SDL_Rect> rects;
+    int previous = -1;
+    for (int line = 0; line < height_;) {
+        if (!dirtyLines[line]) {
+            ++line;
+            continue;
+        }
+
+        int end = line;
+        while (end < height_ && dirtyLines[end]) {
+            ++end;
+        }
+
+        const int first = std::max(line - FILTER_REACH, 0);
+        const int last = std::min(end + FILTER_REACH, height_);
+        const int bottom = target.y + (last * target.h + height_ - 1) / height_;
+
+        if (previous >= first) {
+            rects.back().h = bottom - rects.back().y;
+        } else {
+            SDL_Rect rect;
+            rect.x = target.x;
+            rect.w = target.w;
+            rect.y = target.y + first * target.h / height_;
+            rect.h = bottom - rect.y;
+            rects.push_back(rect);
+        }
+
+        previous = last;
+        line = end;
+    }
+
+    SDL_UpdateWindowSurfaceRects(window_, rects.data(), (int) rects.size());
+}
+
+void yb::Window::setFilter(yb::Filter filter, int factor)
+{
+    scaler_.reset(new yb::Scaler(filter, factor, width_, height_));
+    scaled_.resize(scaler_->outputWidth() * scaler_->outputHeight());
+
+    SDL_SetWindowSize(window_, scaler_->outputWidth(), scaler_->outputHeight());
+    surface_ = SDL_GetWindowSurface(window_);
+    redraw_ = true;
 }
 
 void::yb::Window::update()
 {
     SDL_Event e;
-    if (SDL_PollEvent(&e) != 0) {
+    while (SDL_PollEvent(&e) != 0) {
         if (e.type == SDL_QUIT) {
             isQuit_ = true;
         }
+        else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+            // the old surface is freed along with the resize
+            surface_ = SDL_GetWindowSurface(window_);
+            redraw_ = true;
+        }
+        else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_EXPOSED) {
+            redraw_ = true;
+        }
+        else if (e.type == SDL_KEYDOWN) {
+            buttons_ |= button_for(e.key.keysym.sym);
+        }
+        else if (e.type == SDL_KEYUP) {
+            buttons_ &= ~button_for(e.key.keysym.sym);
+        }
     }
 }
 
@@ -50,6 +182,11 @@ bool yb::Window::isQuit() const noexcept
     return isQuit_;
 }
 
+uint8_t yb::Window::buttons() const noexcept
+{
+    return buttons_;
+}
+
 yb::Window::~Window()
 {
     SDL_FreeSurface(surface_);
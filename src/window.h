@@ -1,10 +1,18 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "scaler.h"
+
 struct SDL_Window;
 struct SDL_Surface;
 
 namespace yb {
 
+    // A resizable window showing width x height frames, upscaled by a filter
+    // and letterboxed into whatever size the window is given.
     class Window
     {
     public:
@@ -14,12 +22,22 @@ namespace yb {
         Window(Window&&) = default;
         Window& operator=(Window&&) = default;
 
-        void draw();
+        // Presents a width x height ARGB8888 frame. Given one flag per line
+        // telling which lines changed since the previous frame, only those rows
+        // of the window are presented, and nothing at all if none changed.
+        void draw(const uint32_t* pixels, const bool* dirtyLines = nullptr);
 
+        // Selects the upscaling filter and resizes the window to fit its output.
+        void setFilter(yb::Filter filter, int factor);
+
+        // Handles pending events: quitting and the keys mapped to the joypad.
         void update();
 
         bool isQuit() const noexcept;
 
+        // Joypad buttons currently held on the keyboard (see yb::Button).
+        uint8_t buttons() const noexcept;
+
     private:
         Window(const Window&) = delete;
         Window& operator=(const Window&) = delete;
@@ -27,6 +45,17 @@ namespace yb {
         SDL_Window* window_;
         SDL_Surface* surface_;
 
+        int width_;
+        int height_;
+
+        std::unique_ptr<yb::Scaler> scaler_;
+        std::vector<uint32_t> scaled_;
+
+        // set when the window's contents were lost, forcing a full present
+        bool redraw_;
+
         bool isQuit_;
+
+        uint8_t buttons_;
     };
 }
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include "yoboy.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "common.h"
+#include "emulator.h"
+#include "joypad.h"
+#include "vector_env.h"
+
+static_assert(YOBOY_SCREEN_WIDTH == YB_SCREEN_WIDTH && YOBOY_SCREEN_HEIGHT == YB_SCREEN_HEIGHT,
+    "yoboy.h disagrees with the PPU on the screen size");
+static_assert((int) YOBOY_BUTTON_RIGHT == (int) yb::BUTTON_RIGHT && (int) YOBOY_BUTTON_START == (int) yb::BUTTON_START,
+    "yoboy.h disagrees with joypad.h on the buttons");
+
+// The handle behind the C API. The state buffer is kept around so that
+// repeated saves don't allocate.
+struct yoboy {
+    explicit yoboy(std::unique_ptr<yb::Emulator> machine)
+        : emulator(std::move(machine))
+    {}
+
+    std::unique_ptr<yb::Emulator> emulator;
+    mutable std::vector<uint8_t> state;
+};
+
+struct yoboy_vec {
+    yoboy_vec(const yb::Cartridge& cartridge, size_t count, size_t threads)
+        : env(cartridge, count, threads)
+    {}
+
+    yb::VectorEnv env;
+    mutable std::vector<uint8_t> state;
+};
+
+namespace yb {
+
+static constexpr unsigned AUDIO_RATE = 48000;
+
+static bool parse_format(int value, yb::FrameFormat& format)
+{
+    switch (value) {
+    case YOBOY_FRAME_ARGB8888:
+        format = yb::FrameFormat::ARGB8888;
+        return true;
+    case YOBOY_FRAME_GRAY8:
+        format = yb::FrameFormat::GRAY8;
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // end namespace
+
+unsigned yoboy_api_version(void)
+{
+    return YOBOY_API_VERSION;
+}
+
+void yoboy_set_logging(int enabled)
+{
+    yb::log_enabled() = enabled != 0;
+}
+
+yoboy* yoboy_create(const uint8_t* rom, size_t size)
+{
+    if (!rom) {
+        return nullptr;
+    }
+
+    // exceptions must not unwind into C callers
+    try {
+        yb::Cartridge cartridge(std::vector<uint8_t>(rom, rom + size));
+        if (!cartridge.isSupported()) {
+            return nullptr;
+        }
+
+        std::unique_ptr<yb::Emulator> emulator(new yb::Emulator(std::move(cartridge), true));
+        return new yoboy(std::move(emulator));
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void yoboy_destroy(yoboy* instance)
+{
+    delete instance;
+}
+
+void yoboy_run_frame(yoboy* instance)
+{
+    instance->emulator->runFrame();
+}
+
+void yoboy_set_input(yoboy* instance, uint8_t buttons)
+{
+    instance->emulator->setInput(buttons);
+}
+
+const uint32_t* yoboy_framebuffer(const yoboy* instance)
+{
+    return instance->emulator->framebuffer();
+}
+
+size_t yoboy_audio_samples(yoboy* instance, int16_t* samples, size_t max_frames)
+{
+    YB_UNUSED(instance);
+    YB_UNUSED(samples);
+    YB_UNUSED(max_frames);
+
+    return 0;
+}
+
+unsigned yoboy_audio_rate(const yoboy* instance)
+{
+    YB_UNUSED(instance);
+
+    return yb::AUDIO_RATE;
+}
+
+size_t yoboy_state_size(const yoboy* instance)
+{
+    // the size depends on what the state holds, like the serial output so far
+    try {
+        instance->emulator->saveState(instance->state);
+    } catch (...) {
+        return 0;
+    }
+
+    return instance->state.size();
+}
+
+size_t yoboy_save_state(const yoboy* instance, void* buffer, size_t size)
+{
+    std::vector<uint8_t>& state = instance->state;
+    try {
+        instance->emulator->saveState(state);
+    } catch (...) {
+        return 0;
+    }
+    if (state.size() > size) {
+        return 0;
+    }
+
+    std::memcpy(buffer, state.data(), state.size());
+    return state.size();
+}
+
+int yoboy_load_state(yoboy* instance, const void* buffer, size_t size)
+{
+    try {
+        return instance->emulator->loadState((const uint8_t*) buffer, size) ? 1 : 0;
+    } catch (...) {
+        return 0;
+    }
+}
+
+yoboy* yoboy_fork(yoboy* instance)
+{
+    try {
+        std::unique_ptr<yb::Emulator> emulator = instance->emulator->fork();
+        return new yoboy(std::move(emulator));
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+yoboy_vec* yoboy_vec_create(const uint8_t* rom, size_t size, size_t count, size_t threads)
+{
+    if (!rom) {
+        return nullptr;
+    }
+
+    // VectorEnv also throws if the pool's threads can't be started
+    try {
+        const yb::Cartridge cartridge(std::vector<uint8_t>(rom, rom + size));
+        if (!cartridge.isSupported()) {
+            return nullptr;
+        }
+
+        return new yoboy_vec(cartridge, count, threads);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void yoboy_vec_destroy(yoboy_vec* vec)
+{
+    delete vec;
+}
+
+size_t yoboy_vec_count(const yoboy_vec* vec)
+{
+    return vec->env.size();
+}
+
+size_t yoboy_vec_frame_size(int format, int downscale)
+{
+    yb::FrameFormat frameFormat;
+    if (!yb::parse_format(format, frameFormat)) {
+        return 0;
+    }
+
+    return yb::VectorEnv::frameSize(frameFormat, downscale);
+}
+
+int yoboy_vec_step(yoboy_vec* vec, const uint8_t* inputs, void* frames, int format, int downscale)
+{
+    yb::FrameFormat frameFormat;
+    if (!yb::parse_format(format, frameFormat)) {
+        return 0;
+    }
+
+    return vec->env.step(inputs, frames, frameFormat, downscale) ? 1 : 0;
+}
+
+uint64_t yoboy_vec_frames(const yoboy_vec* vec, size_t index)
+{
+    return vec->env.frames(index);
+}
+
+void yoboy_vec_reset(yoboy_vec* vec, size_t index)
+{
+    vec->env.reset(index);
+}
+
+size_t yoboy_vec_save_state(const yoboy_vec* vec, size_t index, void* buffer, size_t size)
+{
+    std::vector<uint8_t>& state = vec->state;
+    try {
+        vec->env.machine(index).saveState(state);
+    } catch (...) {
+        return 0;
+    }
+    if (state.size() > size) {
+        return 0;
+    }
+
+    std::memcpy(buffer, state.data(), state.size());
+    return state.size();
+}
+
+int yoboy_vec_load_state(yoboy_vec* vec, size_t index, const void* buffer, size_t size)
+{
+    try {
+        return vec->env.machine(index).loadState((const uint8_t*) buffer, size) ? 1 : 0;
+    } catch (...) {
+        return 0;
+    }
+}
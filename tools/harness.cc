@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "emulator.h"
+#include "testrom.h"
+#include "thread_pool.h"
+
+static void print_help()
+{
+    std::puts("yoboy-harness -- runs blargg/mooneye test ROMs headlessly.");
+
+    std::puts("Usage: yoboy-harness rom.gb [rom.gb ...] [-h] [--frames N] [--jobs N]");
+    std::putchar('\n');
+
+    std::puts("Optional arguments:");
+    std::puts("-h            show this help message and exit.");
+    std::puts("--frames N    frames a ROM may run before timing out (default 7200).");
+    std::puts("--jobs N      number of worker threads (default: one per core).");
+    std::putchar('\n');
+}
+
+static int parse_int(const char* flag, const char* value)
+{
+    char* end = nullptr;
+    const long n = std::strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < 0) {
+        yb::exit("Invalid value %s for %s.\n", value, flag);
+    }
+
+    return (int) n;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> roms;
+    int frames = 7200;
+    int jobs = 0;
+
+    for (int i = 1; i < argc;) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "-h") == 0) {
+            print_help();
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && hasValue) {
+            frames = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--jobs") == 0 && hasValue) {
+            jobs = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (argv[i][0] != '-') {
+            roms.push_back(argv[i]);
+            ++i;
+        }
+        else {
+            yb::exit("Unrecognized argument %s.\n", argv[i]);
+        }
+    }
+
+    if (roms.empty()) {
+        print_help();
+        return 1;
+    }
+
+    yb::log_enabled() = false;
+
+    std::mutex outputMutex;
+    int failures = 0;
+    {
+        yb::ThreadPool pool(jobs);
+        for (const std::string& rom : roms) {
+            pool.submit([&, rom] {
+                yb::TestVerdict verdict = yb::TestVerdict::FAILED;
+                std::string serial;
+
+                yb::Cartridge cartridge = yb::read_cartridge(rom.c_str());
+                if (cartridge.isSupported()) {
+                    yb::Emulator emulator(std::move(cartridge), true);
+                    verdict = yb::run_test_rom(emulator, frames);
+                    serial = emulator.serial();
+                } else {
+                    serial = "unreadable or unsupported ROM";
+                }
+
+                std::lock_guard<std::mutex> lock(outputMutex);
+                if (verdict == yb::TestVerdict::PASSED) {
+                    std::printf("PASS %s\n", rom.c_str());
+                } else {
+                    std::printf("FAIL %s (%s)\n", rom.c_str(), yb::to_string(verdict));
+                    if (!serial.empty()) {
+                        std::printf("%s\n", serial.c_str());
+                    }
+                    ++failures;
+                }
+            });
+        }
+    }
+
+    std::printf("%zu/%zu test ROMs passed.\n", roms.size() - failures, roms.size());
+
+    return failures == 0 ? 0 : 1;
+}
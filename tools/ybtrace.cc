@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <deque>
+#include <string>
+
+#include "common.h"
+#include "trace.h"
+
+static void print_help()
+{
+    std::puts("yoboy-trace -- reads binary instruction traces recorded with yoBoy --trace.");
+
+    std::puts("Usage: yoboy-trace print TRACE [--from N] [--count N]");
+    std::puts("       yoboy-trace diff TRACE_A TRACE_B [--context N]");
+    std::putchar('\n');
+
+    std::puts("Optional arguments:");
+    std::puts("-h            show this help message and exit.");
+    std::puts("--from N      first record to print (default 0).");
+    std::puts("--count N     number of records to print (default: all).");
+    std::puts("--context N   records shown before the first difference (default 8).");
+    std::putchar('\n');
+}
+
+static long long parse_int(const char* flag, const char* value)
+{
+    char* end = nullptr;
+    const long long n = std::strtoll(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < 0) {
+        yb::exit("Invalid value %s for %s.\n", value, flag);
+    }
+
+    return n;
+}
+
+static void print_record(const char* prefix, uint64_t index, const yb::TraceRecord& record)
+{
+    std::printf("%s%10llu %s\n", prefix, (unsigned long long) index, yb::format_trace_record(record).c_str());
+}
+
+static int print_trace(const char* path, uint64_t from, uint64_t count)
+{
+    yb::TraceReader reader;
+    if (!reader.open(path)) {
+        return 1;
+    }
+
+    yb::TraceRecord record;
+    for (uint64_t index = 0; index < from + count && reader.next(record); ++index) {
+        if (index >= from) {
+            print_record("", index, record);
+        }
+    }
+
+    return reader.ok() ? 0 : 1;
+}
+
+static int diff_traces(const char* pathA, const char* pathB, size_t context)
+{
+    yb::TraceReader a;
+    yb::TraceReader b;
+    if (!a.open(pathA) || !b.open(pathB)) {
+        return 1;
+    }
+
+    std::deque<yb::TraceRecord> recent;
+    yb::TraceRecord recordA;
+    yb::TraceRecord recordB;
+
+    for (uint64_t index = 0;; ++index) {
+        const bool moreA = a.next(recordA);
+        const bool moreB = b.next(recordB);
+        if (!a.ok() || !b.ok()) {
+            return 1;
+        }
+
+        if (!moreA && !moreB) {
+            std::printf("The traces match (%llu records).\n", (unsigned long long) index);
+            return 0;
+        }
+
+        if (moreA && moreB && yb::same_trace_record(recordA, recordB)) {
+            recent.push_back(recordA);
+            if (recent.size() > context) {
+                recent.pop_front();
+            }
+            continue;
+        }
+
+        std::printf("The traces diverge at record %llu:\n", (unsigned long long) index);
+        uint64_t first = index - recent.size();
+        for (const yb::TraceRecord& record : recent) {
+            print_record("  ", first++, record);
+        }
+
+        if (moreA) {
+            print_record("- ", index, recordA);
+        } else {
+            std::printf("- %s ends here\n", pathA);
+        }
+
+        if (moreB) {
+            print_record("+ ", index, recordB);
+        } else {
+            std::printf("+ %s ends here\n", pathB);
+        }
+
+        return 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string command;
+    std::string paths[2];
+    int pathCount = 0;
+    uint64_t from = 0;
+    uint64_t count = UINT64_MAX;
+    size_t context = 8;
+
+    for (int i = 1; i < argc;) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "-h") == 0) {
+            print_help();
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--from") == 0 && hasValue) {
+            from = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--count") == 0 && hasValue) {
+            count = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--context") == 0 && hasValue) {
+            context = parse_int(argv[i], argv[i + 1]);
+            i += 2;
+        }
+        else if (argv[i][0] != '-' && command.empty()) {
+            command = argv[i];
+            ++i;
+        }
+        else if (argv[i][0] != '-' && pathCount < 2) {
+            paths[pathCount++] = argv[i];
+            ++i;
+        }
+        else {
+            yb::exit("Unrecognized argument %s.\n", argv[i]);
+        }
+    }
+
+    if (command == "print" && pathCount == 1) {
+        // keep from + count from overflowing
+        return print_trace(paths[0].c_str(), from, std::min(count, UINT64_MAX - from));
+    }
+    if (command == "diff" && pathCount == 2) {
+        return diff_traces(paths[0].c_str(), paths[1].c_str(), context);
+    }
+
+    print_help();
+    return 1;
+}